@@ -11,21 +11,368 @@
 import importlib
 import time
 import re
+import os
+import json
+import select
+import shlex
+import signal
+import subprocess
 import pexpect
 import argparse
 import junitparser
 import multiprocessing
+import multiprocessing.connection
 from datetime import datetime
 import tempfile
 from os.path import exists
 import inspect
 
-from rtps_test_utilities import ReturnCode, log_message, no_check
+from rtps_test_utilities import ReturnCode, log_message, no_check, \
+        parse_performance_report, ResourceMonitor
 
 # This parameter is used to save the samples the Publisher sends.
 # MAX_SAMPLES_SAVED is the maximum number of samples saved.
 MAX_SAMPLES_SAVED = 100
 
+# Highest domain id that the RTPS well-known ports allow with the default
+# port mapping. With --jobs the Test Cases are spread over domains 0 to
+# MAX_DOMAIN_ID.
+MAX_DOMAIN_ID = 232
+
+# Event that shape_main writes with --events for each of the string patterns
+# the Publisher and Subscriber steps (and the check functions) expect.
+EVENT_FOR_PATTERN = {
+    'Create topic:': 'topic_created',
+    'Create writer for topic': 'writer_created',
+    'Create reader for topic:': 'reader_created',
+    'failed to create content filtered topic': 'filter_not_created',
+    'on_publication_matched()': 'publication_matched',
+    'on_subscription_matched()': 'subscription_matched',
+    'on_offered_incompatible_qos': 'offered_incompatible_qos',
+    'on_requested_incompatible_qos()': 'requested_incompatible_qos',
+    'on_liveliness_changed()': 'liveliness_changed',
+    '\[[0-9]{2}\]': 'sample'
+}
+
+# What else an event must fulfill to match the pattern, as the console line
+# would: the sample pattern only matches a shapesize of two digits.
+EVENT_CONDITION = {
+    '\[[0-9]{2}\]': lambda event: 10 <= event['shapesize'] <= 99
+}
+
+class ShapeMainEvents:
+    """ Runs a shape_main application that writes its events as JSON lines
+        on a pipe (--events <fd>) and follows it through them instead of
+        matching its console output, which is saved to 'logfile'.
+
+        It offers the part of the pexpect child interface that the
+        Publisher/Subscriber steps and the check functions use: expect()
+        with the same patterns (see EVENT_FOR_PATTERN), pexpect.TIMEOUT and
+        pexpect.EOF, 'before' + 'after', which contain the sample line
+        after a sample is matched, kill(), 'logfile' and 'pid'.
+    """
+    def __init__(self, command: str, logfile: tempfile.TemporaryFile):
+        read_fd, write_fd = os.pipe()
+        self.process = subprocess.Popen(
+                shlex.split(command) + ['--events', str(write_fd)],
+                stdout=logfile, stderr=subprocess.STDOUT,
+                pass_fds=(write_fd,))
+        os.close(write_fd)
+        self.pid = self.process.pid
+        self.logfile = logfile
+        self.fd = read_fd
+        self.buffer = b''
+        self.eof = False
+        self.before = ''
+        self.after = ''
+        # time of the first event of each kind, in ns of CLOCK_MONOTONIC
+        self.first_time_ns = {}
+
+    def expect(self, patterns: list, timeout: float) -> int:
+        # a pattern without event would only time out
+        for pattern in patterns:
+            if isinstance(pattern, str) and pattern not in EVENT_FOR_PATTERN:
+                raise KeyError(f'No --events equivalent of the pattern {pattern!r}, '
+                        'add it to EVENT_FOR_PATTERN')
+        names = [EVENT_FOR_PATTERN[p] if isinstance(p, str) else p
+                for p in patterns]
+        deadline = time.monotonic() + timeout
+        while True:
+            event = self.next_event(deadline)
+            if event is pexpect.TIMEOUT or event is pexpect.EOF:
+                if event in names:
+                    return names.index(event)
+                raise event(f'{event.__name__} waiting for {patterns}')
+            self.first_time_ns.setdefault(event['event'], event['time_ns'])
+            index = next((i for i, name in enumerate(names)
+                    if name == event['event']
+                    and EVENT_CONDITION.get(patterns[i], lambda e: True)(event)),
+                    None)
+            if index is not None:
+                if event['event'] == 'sample':
+                    self.before = f'{event["topic"]:<10} {event["color"]:<10} ' \
+                            f'{event["x"]:03d} {event["y"]:03d} '
+                    self.after = f'[{event["shapesize"]}]'
+                else:
+                    self.before = ''
+                    self.after = event['event']
+                return index
+
+    def next_event(self, deadline: float):
+        while b'\n' not in self.buffer:
+            if self.eof:
+                return pexpect.EOF
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return pexpect.TIMEOUT
+            readable, _, _ = select.select([self.fd], [], [], remaining)
+            if not readable:
+                return pexpect.TIMEOUT
+            data = os.read(self.fd, 65536)
+            if not data:
+                self.eof = True
+            self.buffer += data
+        line, self.buffer = self.buffer.split(b'\n', 1)
+        return json.loads(line)
+
+    def timing(self) -> str:
+        """ Time of the first event of each kind since the topic creation """
+        start = self.first_time_ns.get('topic_created')
+        if start is None:
+            return 'no events'
+        return ', '.join(f'{name} +{(time_ns - start) / 1e6:.1f} ms'
+                for name, time_ns in self.first_time_ns.items())
+
+    def kill(self, sig: int):
+        if self.process.poll() is None:
+            self.process.send_signal(sig)
+
+    def close(self):
+        if self.process.poll() is None:
+            self.process.send_signal(signal.SIGINT)
+            try:
+                self.process.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
+        if self.fd >= 0:
+            os.close(self.fd)
+            self.fd = -1
+
+    def __del__(self):
+        self.close()
+
+
+class ShapeMainServer:
+    """ A shape_main application started with --server, that runs the
+        shape_main applications of the Test Cases as sessions (see
+        ShapeMainSession) on participants it keeps from one Test Case to the
+        next, so that they are created and discover each other only once.
+
+        Its console output goes to a pipe that the sessions read, and with
+        'use_events' its events (--events) to another one. It runs one
+        session at a time, so the output and the events are the session's.
+    """
+    def __init__(self, command: str, use_events: bool):
+        events_options = []
+        pass_fds = ()
+        self.events_fd = -1
+        if use_events:
+            self.events_fd, write_fd = os.pipe()
+            events_options = ['--events', str(write_fd)]
+            pass_fds = (write_fd,)
+        self.process = subprocess.Popen(
+                shlex.split(command) + ['--server'] + events_options,
+                stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                stderr=subprocess.STDOUT, pass_fds=pass_fds)
+        if use_events:
+            os.close(write_fd)
+        self.pid = self.process.pid
+        self.output_fd = self.process.stdout.fileno()
+
+    def send(self, command: str):
+        """ Sends a command; if the server is gone the session notices it
+            as the end of its output.
+        """
+        try:
+            self.process.stdin.write(f'{command}\n'.encode())
+            self.process.stdin.flush()
+        except OSError:
+            pass
+
+    def close(self):
+        if self.process.poll() is None:
+            self.send('quit')
+            try:
+                self.process.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
+        if self.events_fd >= 0:
+            os.close(self.events_fd)
+            self.events_fd = -1
+
+
+class ShapeMainSession(ShapeMainEvents):
+    """ Runs 'parameters' as a session of a ShapeMainServer, followed as if
+        it were a shape_main application of its own: through its events
+        (as ShapeMainEvents) when the server writes them, or else through
+        the patterns of its console output (as pexpect). The console
+        output is saved to 'logfile' either way.
+
+        The session is deleted by kill() and close(), and pexpect.EOF is
+        matched once the server answers the delete command (or the create
+        command fails), after the reports of the session. 'pid' is the
+        server's: the resource usage is the one of the whole server.
+    """
+    def __init__(self, server: ShapeMainServer, parameters: str,
+            logfile: tempfile.TemporaryFile):
+        self.server = server
+        self.name = f'session_{os.getpid()}'
+        self.pid = server.pid
+        self.logfile = logfile
+        self.fd = server.events_fd
+        self.buffer = b''
+        self.output = b''
+        self.text = ''          # console output not matched yet
+        self.events = []        # events not returned yet
+        self.eof = False
+        self.deleted = False
+        self.before = ''
+        self.after = ''
+        self.first_time_ns = {}
+        # the answers of the server to the commands of this session
+        self.reply = re.compile(f'^(OK|ERROR) (create|delete) {self.name}\\b')
+        server.send(f'create {self.name} {parameters}')
+
+    def read(self, deadline: float) -> bool:
+        """ Reads what the server writes until 'deadline': False if it
+            wrote nothing.
+        """
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            return False
+        fds = [self.server.output_fd] + ([self.fd] if self.fd >= 0 else [])
+        readable, _, _ = select.select(fds, [], [], remaining)
+        if not readable:
+            return False
+        if self.fd in readable:
+            self.buffer += os.read(self.fd, 65536)
+            *lines, self.buffer = self.buffer.split(b'\n')
+            self.events += [json.loads(line) for line in lines]
+        if self.server.output_fd in readable:
+            data = os.read(self.server.output_fd, 65536)
+            if not data:
+                self.eof = True
+            self.output += data
+            *lines, self.output = self.output.split(b'\n')
+            for line in lines:
+                line = line.decode(errors='replace')
+                self.logfile.write(line + '\n')
+                match = self.reply.match(line)
+                if match is None:
+                    self.text += line + '\n'
+                elif match.group(2) == 'delete' or match.group(1) == 'ERROR':
+                    self.eof = True
+        return True
+
+    def next_event(self, deadline: float):
+        while not self.events:
+            if self.eof:
+                return pexpect.EOF
+            if not self.read(deadline):
+                return pexpect.TIMEOUT
+        return self.events.pop(0)
+
+    def expect(self, patterns: list, timeout: float) -> int:
+        if self.fd >= 0:
+            return super().expect(patterns, timeout)
+        # the first match in the output, as pexpect
+        deadline = time.monotonic() + timeout
+        while True:
+            found = None
+            for index, pattern in enumerate(patterns):
+                if not isinstance(pattern, str):
+                    continue
+                match = re.search(pattern, self.text)
+                if match and (found is None or match.start() < found[1].start()):
+                    found = (index, match)
+            if found is not None:
+                index, match = found
+                self.before = self.text[:match.start()]
+                self.after = match.group(0)
+                self.text = self.text[match.end():]
+                return index
+            if self.eof:
+                event = pexpect.EOF
+            elif not self.read(deadline):
+                event = pexpect.TIMEOUT
+            else:
+                continue
+            if event in patterns:
+                self.before = self.text
+                self.after = event
+                self.text = ''
+                return patterns.index(event)
+            raise event(f'{event.__name__} waiting for {patterns}')
+
+    def kill(self, sig: int):
+        if not self.deleted and not self.eof:
+            self.deleted = True
+            self.server.send(f'delete {self.name}')
+
+    def close(self):
+        """ Deletes the session and reads what the server wrote for it, so
+            that the next session only reads its own output and events.
+        """
+        self.kill(signal.SIGINT)
+        deadline = time.monotonic() + 10
+        while not self.eof and self.read(deadline):
+            pass
+        while self.fd >= 0 and select.select([self.fd], [], [], 0)[0]:
+            os.read(self.fd, 65536)
+        self.fd = -1
+
+    def __del__(self):
+        self.close()
+
+
+def split_server_options(parameters: str) -> "tuple[str, str]":
+    """ Splits the shape_main parameters into the ones that apply to the
+        whole application (--output, -v), which go on the command line of
+        the ShapeMainServer, and the ones of the session.
+    """
+    server_words = []
+    session_words = []
+    words = parameters.split()
+    i = 0
+    while i < len(words):
+        if words[i] in ('--output', '-v') and i + 1 < len(words):
+            server_words += words[i:i + 2]
+            i += 2
+        else:
+            session_words.append(words[i])
+            i += 1
+    return ' '.join(server_words), ' '.join(session_words)
+
+def spawn_shape_main(
+        name_executable: str,
+        parameters: str,
+        file: tempfile.TemporaryFile,
+        use_events: bool,
+        server: ShapeMainServer = None):
+    """ Runs the shape_main application, followed through its events
+        (ShapeMainEvents) or its console output (pexpect), or as a session
+        of 'server' (ShapeMainSession).
+    """
+    if server is not None:
+        return ShapeMainSession(server, split_server_options(parameters)[1], file)
+    if use_events:
+        return ShapeMainEvents(f'{name_executable} {parameters}', file)
+    child = pexpect.spawnu(f'{name_executable} {parameters}')
+    child.logfile = file
+    return child
+
 def run_subscriber_shape_main(
         name_executable: str,
         parameters: str,
@@ -38,7 +385,10 @@ def run_subscriber_shape_main(
         file: tempfile.TemporaryFile,
         subscriber_finished: multiprocessing.Event,
         publishers_finished: "list[multiprocessing.Event]",
-        check_function: "function"):
+        check_function: "function",
+        use_events: bool,
+        resource_usage: dict,
+        server: ShapeMainServer = None):
 
     """ This function runs the subscriber shape_main application with
         the specified parameters. Then it saves the
@@ -66,6 +416,13 @@ def run_subscriber_shape_main(
                 Element 1 of the list is for Publisher 1, etc.
         check_function <<in>>: function to check how the samples are received
                 by the Subscriber. By default it does not check anything.
+        use_events <<in>>: follow the shape_main application through
+                the events it writes with --events instead of its output.
+        resource_usage <<out>>: the cpu, memory, context switches and threads
+                the shape_main application used (see ResourceMonitor) are
+                saved in resource_usage[produced_code_index].
+        server <<in>>: ShapeMainServer that runs the shape_main application
+                as a session, None to run it in a process of its own.
 
         The function runs the shape_main application as a Subscriber
         with the parameters defined.
@@ -89,8 +446,9 @@ def run_subscriber_shape_main(
     # Step 1 : run the executable
     log_message(f'Running shape_main application Subscriber {subscriber_index}',
             verbosity)
-    child_sub = pexpect.spawnu(f'{name_executable} {parameters}')
-    child_sub.logfile = file
+    child_sub = spawn_shape_main(name_executable, parameters, file, use_events,
+            server)
+    monitor = ResourceMonitor(child_sub.pid)
 
     # Step 2 : Check if the topic is created
     log_message(f'Subscriber {subscriber_index}: Waiting for topic creation',
@@ -177,6 +535,10 @@ def run_subscriber_shape_main(
                                                                 samples_sent,
                                                                 timeout)
 
+    if use_events:
+        log_message(f'Subscriber {subscriber_index}: {child_sub.timing()}',
+                verbosity)
+    resource_usage[produced_code_index] = monitor.stop()
     subscriber_finished.set()   # set subscriber as finished
     log_message(f'Subscriber {subscriber_index}: Waiting for Publishers to '
             'finish', verbosity)
@@ -196,7 +558,10 @@ def run_publisher_shape_main(
         timeout: int,
         file: tempfile.TemporaryFile,
         subscribers_finished: "list[multiprocessing.Event]",
-        publisher_finished: multiprocessing.Event):
+        publisher_finished: multiprocessing.Event,
+        use_events: bool,
+        resource_usage: dict,
+        server: ShapeMainServer = None):
 
     """ This function runs the publisher shape_main application with
         the specified parameters. Then it saves the
@@ -221,6 +586,13 @@ def run_publisher_shape_main(
                 Element 1 of the list is for Subscriber 1, etc.
         publisher_finished <<inout>>: object event from multiprocessing
                 that is set when the publisher is finished.
+        use_events <<in>>: follow the shape_main application through
+                the events it writes with --events instead of its output.
+        resource_usage <<out>>: the cpu, memory, context switches and threads
+                the shape_main application used (see ResourceMonitor) are
+                saved in resource_usage[produced_code_index].
+        server <<in>>: ShapeMainServer that runs the shape_main application
+                as a session, None to run it in a process of its own.
 
         The function runs the shape_main application as a Publisher
         with the parameters defined.
@@ -243,8 +615,9 @@ def run_publisher_shape_main(
     # Step 1 : run the executable
     log_message(f'Running shape_main application Publisher {publisher_index}',
             verbosity)
-    child_pub = pexpect.spawnu(f'{name_executable} {parameters}')
-    child_pub.logfile = file
+    child_pub = spawn_shape_main(name_executable, parameters, file, use_events,
+            server)
+    monitor = ResourceMonitor(child_pub.pid)
 
     # Step 2 : Check if the topic is created
     log_message(f'Publisher {publisher_index}: Waiting for topic creation',
@@ -328,10 +701,14 @@ def run_publisher_shape_main(
                 else:
                     produced_code[produced_code_index] = ReturnCode.OK
 
+    if use_events:
+        log_message(f'Publisher {publisher_index}: {child_pub.timing()}',
+                verbosity)
     log_message(f'Publisher {publisher_index}: Waiting for Subscribers to finish',
             verbosity)
     for element in subscribers_finished:
         element.wait() # wait for all subscribers to finish
+    resource_usage[produced_code_index] = monitor.stop()
     publisher_finished.set()   # set publisher as finished
     return
 
@@ -344,7 +721,10 @@ def run_test(
     expected_codes: "list[str]",
     verbosity: bool,
     timeout: int,
-    check_function: "function"):
+    check_function: "function",
+    use_events: bool,
+    servers: dict = None,
+    report_parameters: "list[str]" = None):
 
     """ Run the Publisher and the Subscriber applications and check
         the actual and the expected ReturnCode.
@@ -361,6 +741,16 @@ def run_test(
         timeout <<in>>: time pexpect waits until it matches a pattern.
         check_function <<in>>: function to check how the samples are received
                 by the Subscriber. By default it does not check anything.
+        use_events <<in>>: follow the shape_main applications through
+                the events they write with --events instead of their output.
+        servers <<inout>>: None to run each shape_main application in
+                a process of its own. Otherwise the ShapeMainServers that
+                run them as sessions: the one of each executable, entity
+                index and server options (see split_server_options) is
+                started the first time it is needed and kept in 'servers'
+                for the next Test Cases.
+        report_parameters <<in>>: the parameters written to the report,
+                if they are not 'parameters' (see run_tests_in_parallel).
 
         The function runs several different processes: one for each Publisher
         and one for each Subscriber shape_main application.
@@ -376,7 +766,9 @@ def run_test(
             f'    expected_codes: {expected_codes}\n'
             f'    verbosity: {verbosity}\n'
             f'    timeout: {timeout}\n'
-            f'    check_function: {check_function.__name__}',
+            f'    check_function: {check_function.__name__}\n'
+            f'    use_events: {use_events}\n'
+            f'    server: {servers is not None}',
             verbosity)
 
     # numbers of publishers/subscriber we will have. It depends on how
@@ -401,6 +793,8 @@ def run_test(
     #     - return_codes[1] contains Subscriber shape_main application ReturnCode
     manager = multiprocessing.Manager()
     return_codes = manager.list(range(num_entities))
+    # what each shape_main application cost, in the same index
+    resource_usage = manager.dict()
     samples_sent = [] # used for storing the samples the Publishers send.
                       # It is a list with one Queue for each Publisher.
 
@@ -436,6 +830,20 @@ def run_test(
 
     # Create and run the processes for the different shape_main applications
     for i in range(0, num_entities):
+        if ('-P ' in parameters[i] or parameters[i].endswith('-P')):
+            name_executable = name_executable_pub
+        else:
+            name_executable = name_executable_sub
+        # started here, so that the processes of the next Test Cases
+        # inherit it too
+        server = None
+        if servers is not None:
+            key = (name_executable, i, split_server_options(parameters[i])[0])
+            if key not in servers:
+                servers[key] = ShapeMainServer(f'{name_executable} {key[2]}',
+                        use_events)
+            server = servers[key]
+
         if ('-P ' in parameters[i] or parameters[i].endswith('-P')):
             entity_process.append(multiprocessing.Process(
                     target=run_publisher_shape_main,
@@ -450,7 +858,10 @@ def run_test(
                         'timeout':timeout,
                         'file':temporary_file[i],
                         'subscribers_finished':subscribers_finished,
-                        'publisher_finished':publishers_finished[publisher_number]}))
+                        'publisher_finished':publishers_finished[publisher_number],
+                        'use_events':use_events,
+                        'resource_usage':resource_usage,
+                        'server':server}))
             publisher_number += 1
             entity_type.append(f'Publisher_{publisher_number}')
 
@@ -469,7 +880,10 @@ def run_test(
                         'file':temporary_file[i],
                         'subscriber_finished':subscribers_finished[subscriber_number],
                         'publishers_finished':publishers_finished,
-                        'check_function':check_function}))
+                        'check_function':check_function,
+                        'use_events':use_events,
+                        'resource_usage':resource_usage,
+                        'server':server}))
             subscriber_number += 1
             entity_type.append(f'Subscriber_{subscriber_number}')
         else:
@@ -492,7 +906,28 @@ def run_test(
     # create an attribute for each entity that will contain their parameters
     for i in range(0, num_entities):
         junitparser.TestCase.i = junitparser.Attr(entity_type[i])
-        test_case.i = parameters[i]
+        test_case.i = (report_parameters or parameters)[i]
+
+    # the resources each entity used are saved as properties, e.g.
+    # Publisher_1.rss_peak_kb. The performance check functions (see
+    # test_suite_performance.py) have thresholds: they and the metrics each
+    # entity reported are saved too, e.g. Subscriber_1.latency_p99_us
+    properties = []
+    if hasattr(check_function, 'thresholds'):
+        for name, value in check_function.thresholds.items():
+            properties.append((f'threshold.{name}', value))
+    for i in range(0, num_entities):
+        metrics = resource_usage.get(i, {})
+        log_message(f'{entity_type[i]} resource usage: {metrics}', verbosity)
+        if hasattr(check_function, 'thresholds'):
+            metrics.update(parse_performance_report(shape_main_application_output[i]))
+        for name, value in metrics.items():
+            properties.append((f'{entity_type[i]}.{name}', value))
+    if properties:
+        junit_properties = junitparser.Properties()
+        for name, value in properties:
+            junit_properties.add_property(junitparser.Property(name, str(value)))
+        test_case.append(junit_properties)
 
     # code[i] contains publisher/subscriber i shape_main application ReturnCode,
     # If we have 1 Publisher (index 0) and 1 Subscriber (index 1):
@@ -545,6 +980,122 @@ def run_test(
     for element in temporary_file:
         element.close()
 
+def domains_used(parameters: "list[str]") -> int:
+    """ Number of consecutive domains, starting at 0, that the shape_main
+        applications of a Test Case use (with -d <domain_id>).
+    """
+    highest = 0
+    for element in parameters:
+        words = element.split()
+        if '-d' in words:
+            highest = max(highest, int(words[words.index('-d') + 1]))
+    return highest + 1
+
+def move_to_domains(parameters: "list[str]", first_domain: int) -> "list[str]":
+    """ Moves the shape_main applications of a Test Case to the domains that
+        start at 'first_domain': '-d <n>' becomes '-d <first_domain + n>'
+        and the applications without -d go to 'first_domain'. Test Cases
+        that run at the same time do not discover each other then.
+    """
+    moved = []
+    for element in parameters:
+        words = element.split()
+        if '-d' in words:
+            index = words.index('-d') + 1
+            words[index] = str(first_domain + int(words[index]))
+        else:
+            words += ['-d', str(first_domain)]
+        moved.append(' '.join(words))
+    return moved
+
+def run_test_case_process(
+        connection: multiprocessing.connection.Connection,
+        case_name: str,
+        **run_test_arguments):
+    """ Runs a Test Case (see run_test) in a process of its own and sends
+        the XML of its junitparser TestCase through 'connection'.
+    """
+    case = junitparser.TestCase(case_name)
+    now_test_case = datetime.now()
+    run_test(test_case=case, **run_test_arguments)
+    case.time = (datetime.now() - now_test_case).total_seconds()
+    connection.send(case.tostring())
+    connection.close()
+
+def run_tests_in_parallel(
+        test_cases: list,
+        jobs: int,
+        **run_test_arguments) -> "list[junitparser.TestCase]":
+    """ Runs up to 'jobs' Test Cases at the same time, each one in a process
+        of its own and on domains of its own (see move_to_domains).
+
+        test_cases <<in>>: list of (case_name, parameters, expected_codes,
+                check_function) tuples.
+        jobs <<in>>: maximum number of Test Cases running at the same time,
+                lowered (with a warning) to the number of domain blocks.
+        run_test_arguments <<in>>: the other parameters of run_test.
+
+        The domains are handed out in blocks, the least recently used first,
+        so that a domain is reused as late as possible. They only change
+        the command lines: the report shows the parameters of the Test
+        Suite. The TestCases are returned in the order of 'test_cases',
+        whatever order they finish in.
+    """
+    width = max([domains_used(element[1]) for element in test_cases] + [1])
+    free_domains = list(range(0, MAX_DOMAIN_ID + 1 - width + 1, width))
+    if jobs > len(free_domains):
+        print(f'Warning: cannot run {jobs} Test Cases at the same time on '
+                f'different domains, running {len(free_domains)} instead.')
+        jobs = len(free_domains)
+
+    results = [None] * len(test_cases)
+    pending = list(range(len(test_cases)))
+    # connection -> (index of the Test Case, process, first domain)
+    running = {}
+    while pending or running:
+        while pending and len(running) < jobs:
+            index = pending.pop(0)
+            case_name, parameters, expected_codes, check_function = \
+                    test_cases[index]
+            first_domain = free_domains.pop(0)
+            receiver, sender = multiprocessing.Pipe(duplex=False)
+            process = multiprocessing.Process(
+                    target=run_test_case_process,
+                    kwargs={
+                        'connection':sender,
+                        'case_name':case_name,
+                        'parameters':move_to_domains(parameters, first_domain),
+                        'report_parameters':parameters,
+                        'expected_codes':expected_codes,
+                        'check_function':check_function,
+                        **run_test_arguments})
+            process.start()
+            sender.close()
+            running[receiver] = (index, process, first_domain)
+
+        # a Test Case is over when its process sends the result or exits
+        # without it
+        waiting = list(running.keys()) + \
+                [element[1].sentinel for element in running.values()]
+        ready = multiprocessing.connection.wait(waiting)
+        for receiver in list(running.keys()):
+            index, process, first_domain = running[receiver]
+            if receiver not in ready and process.sentinel not in ready:
+                continue
+            try:
+                results[index] = junitparser.TestCase.fromstring(receiver.recv())
+            except EOFError:
+                results[index] = junitparser.TestCase(test_cases[index][0])
+                results[index].result = [junitparser.Error(
+                        'The process of the Test Case exited without result, '
+                        f'exit code: {process.exitcode}')]
+            process.join()
+            receiver.close()
+            free_domains.append(first_domain)
+            del running[receiver]
+
+    return results
+
 class Arguments:
     def parser():
         parser = argparse.ArgumentParser(
@@ -583,6 +1134,42 @@ class Arguments:
                 'shape_main application output in case of error. '
                 'If this option is not used, only the test results are printed '
                 'in the stdout. (Default: False).')
+        optional.add_argument('-e', '--events',
+            default=False,
+            required=False,
+            action='store_true',
+            help='Follow the shape_main applications through the events they '
+                'write with --events on a pipe, instead of matching patterns '
+                'in their console output. With --verbose it also prints '
+                'when each step happened. The shape_main applications must '
+                'support --events. (Default: False).')
+        optional.add_argument('-j', '--jobs',
+            default=1,
+            required=False,
+            type=int,
+            metavar='number_of_jobs',
+            help='Number of Test Cases that run at the same time. Each Test '
+                'Case runs on domains of its own (-d is added to, or shifted '
+                'in, the shape_main parameters), so that they do not discover '
+                'each other. (Default: 1, one after another, with the domains '
+                'of the Test Suite).')
+        optional.add_argument('--server',
+            default=False,
+            required=False,
+            action='store_true',
+            help='Run the shape_main applications as sessions of shape_main '
+                'applications started with --server and kept from one Test '
+                'Case to the next, so that their participants are created '
+                'and discover each other only once. The resource usage '
+                'reported is then the one of the servers. Not supported '
+                'with --jobs. (Default: False).')
+        optional.add_argument('--timeout',
+            default=6,
+            required=False,
+            type=int,
+            metavar='seconds',
+            help='Time to wait for each step of the shape_main applications, '
+                'e.g. the match or the first sample. (Default: 6).')
 
         tests = parser.add_argument_group(title='Test Case and Test Suite')
         tests.add_argument('-s', '--suite',
@@ -651,6 +1238,10 @@ def main():
         'publisher': args.publisher,
         'subscriber': args.subscriber,
         'verbosity': args.verbose,
+        'use_events': args.events,
+        'server': args.server,
+        'jobs': args.jobs,
+        'timeout': args.timeout,
         'test_suite': args.suite,
         'test_cases': args.test,
         'test_cases_disabled': args.disable_test
@@ -686,8 +1277,18 @@ def main():
     # applications. A TestSuite contains a collection of TestCases.
     suite = junitparser.TestSuite(f"{name_publisher}---{name_subscriber}")
 
-    timeout = 6
+    if options['jobs'] < 1:
+        raise RuntimeError('The number of jobs must be at least 1.')
+    if options['server'] and options['jobs'] > 1:
+        raise RuntimeError('--server runs the Test Cases one after another, '
+                'it is not supported with --jobs.')
+    # with --server, the ShapeMainServers of run_test
+    servers = {} if options['server'] else None
+
     now = datetime.now()
+    # Test Cases to run with --jobs, as (case_name, parameters,
+    # expected_codes, check_function)
+    parallel_test_cases = []
 
     t_suite_module = importlib.import_module(options['test_suite'])
     for test_suite_name, t_suite_dict in inspect.getmembers(t_suite_module):
@@ -744,6 +1345,14 @@ def main():
 
                     assert(len(parameters) == len(expected_codes))
 
+                    if options['jobs'] > 1:
+                        parallel_test_cases.append((
+                                f'{test_suite_name}_{test_case_name}',
+                                parameters,
+                                expected_codes,
+                                check_function))
+                        continue
+
                     case = junitparser.TestCase(f'{test_suite_name}_{test_case_name}')
                     now_test_case = datetime.now()
                     run_test(name_executable_pub=options['publisher'],
@@ -752,11 +1361,28 @@ def main():
                             parameters=parameters,
                             expected_codes=expected_codes,
                             verbosity=options['verbosity'],
-                            timeout=timeout,
-                            check_function=check_function)
+                            timeout=options['timeout'],
+                            check_function=check_function,
+                            use_events=options['use_events'],
+                            servers=servers)
                     case.time = (datetime.now() - now_test_case).total_seconds()
                     suite.add_testcase(case)
 
+    if parallel_test_cases:
+        for case in run_tests_in_parallel(
+                test_cases=parallel_test_cases,
+                jobs=options['jobs'],
+                name_executable_pub=options['publisher'],
+                name_executable_sub=options['subscriber'],
+                verbosity=options['verbosity'],
+                timeout=options['timeout'],
+                use_events=options['use_events']):
+            suite.add_testcase(case)
+
+    if servers is not None:
+        for server in servers.values():
+            server.close()
+
     suite.time = (datetime.now() - now).total_seconds()
     xml.add_testsuite(suite)
 
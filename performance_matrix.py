@@ -0,0 +1,123 @@
+#!/usr/bin/python
+#################################################################
+# Use and redistribution is source and binary forms is permitted
+# subject to the OMG-DDS INTEROPERABILITY TESTING LICENSE found
+# at the following URL:
+#
+# https://github.com/omg-dds/dds-rtps/blob/master/LICENSE.md
+#
+#################################################################
+
+import argparse
+import xml.etree.ElementTree as ElementTree
+
+# Metrics shown by default, as named in the properties of the Test Cases
+# (see run_test in interoperability_report.py)
+DEFAULT_METRICS = [
+    'Subscriber_1.throughput_samples_per_s',
+    'Subscriber_1.throughput_mb_per_s',
+    'Subscriber_1.loss_ratio',
+    'Subscriber_1.latency_p50_us',
+    'Subscriber_1.latency_p99_us'
+]
+
+def read_performance_results(filenames: "list[str]") -> dict:
+    """ Reads the Test Cases with properties (the metrics of the performance
+        Test Cases and the resources each application used) of the JUnit
+        reports that interoperability_report.py generated.
+
+        Returns a dictionary: test case name -> (publisher, subscriber) ->
+        (properties, passed), where the publisher and the subscriber come
+        from the name of the Test Suite, '<publisher>---<subscriber>'.
+    """
+    results = {}
+    for filename in filenames:
+        root = ElementTree.parse(filename).getroot()
+        for suite in root.iter('testsuite'):
+            if '---' not in suite.get('name', ''):
+                continue
+            publisher, subscriber = suite.get('name').split('---', 1)
+            for case in suite.iter('testcase'):
+                properties = {element.get('name'): element.get('value')
+                        for element in case.iter('property')}
+                if not properties:
+                    continue
+                passed = case.find('failure') is None \
+                        and case.find('error') is None
+                results.setdefault(case.get('name'), {})[
+                        (publisher, subscriber)] = (properties, passed)
+    return results
+
+def render_matrix(test_case: str, metric: str, results: dict) -> str:
+    """ Markdown table of one metric of one Test Case: a row for each
+        Publisher implementation and a column for each Subscriber one.
+        The Test Cases that did not meet their thresholds are marked with
+        :x:, the missing results are shown as '-'.
+    """
+    publishers = sorted({publisher for publisher, _ in results})
+    subscribers = sorted({subscriber for _, subscriber in results})
+    lines = [f'### {test_case}: {metric}', '',
+            '| Publisher \\ Subscriber | ' + ' | '.join(subscribers) + ' |',
+            '|---' * (len(subscribers) + 1) + '|']
+    for publisher in publishers:
+        cells = []
+        for subscriber in subscribers:
+            properties, passed = results.get((publisher, subscriber), ({}, True))
+            value = properties.get(metric)
+            if value is None:
+                cells.append('-')
+            else:
+                cells.append(f'{float(value):.6g}' + ('' if passed else ' :x:'))
+        lines.append(f'| {publisher} | ' + ' | '.join(cells) + ' |')
+    threshold = metric.split('.', 1)[-1]
+    limits = [f'{name}: {value}' for name, value in
+            next(iter(results.values()))[0].items()
+            if name.startswith('threshold.') and threshold in name]
+    if limits:
+        lines += ['', ', '.join(limits)]
+    return '\n'.join(lines) + '\n'
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Renders the metrics of the performance Test Cases '
+            '(see test_suite_performance.py) of JUnit reports generated by '
+            'interoperability_report.py as Markdown tables: one for each '
+            'Test Case and metric, with a row for each Publisher '
+            'implementation and a column for each Subscriber one.',
+        add_help=True)
+    parser.add_argument('-i', '--input',
+        nargs='+',
+        required=True,
+        type=str,
+        metavar='junit_report',
+        help='JUnit reports to read.')
+    parser.add_argument('-m', '--metrics',
+        nargs='+',
+        default=DEFAULT_METRICS,
+        type=str,
+        metavar='metric',
+        help='Metrics to render, as named in the properties of the Test '
+            'Cases, e.g. Publisher_1.rss_peak_kb. (Default: ' + ' '.join(DEFAULT_METRICS) + ').')
+    parser.add_argument('-o', '--output-name',
+        required=False,
+        metavar='filename',
+        type=str,
+        help='File to write the tables to. (Default: stdout).')
+    args = parser.parse_args()
+
+    results = read_performance_results(args.input)
+    tables = []
+    for test_case in sorted(results):
+        for metric in args.metrics:
+            if any(metric in properties
+                    for properties, _ in results[test_case].values()):
+                tables.append(render_matrix(test_case, metric, results[test_case]))
+
+    if args.output_name is None:
+        print('\n'.join(tables))
+    else:
+        with open(args.output_name, 'w') as output:
+            output.write('\n'.join(tables))
+
+if __name__ == '__main__':
+    main()
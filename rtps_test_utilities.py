@@ -7,6 +7,9 @@
 #
 #################################################################
 
+import os
+import re
+import threading
 from enum import Enum
 class ReturnCode(Enum):
     """"
@@ -26,6 +29,8 @@ class ReturnCode(Enum):
     DATA_NOT_CORRECT     : Subscriber does not find the data expected
     RECEIVING_FROM_ONE   : Subscriber receives from one Publisher
     RECEIVING_FROM_BOTH  : Subscriber receives from two Publishers
+    PERFORMANCE_NOT_MET  : Subscriber measures a throughput, loss or latency
+                           beyond the thresholds of the Test Case
     """
     OK = 0
     TOPIC_NOT_CREATED = 1
@@ -41,6 +46,7 @@ class ReturnCode(Enum):
     DATA_NOT_CORRECT = 11
     RECEIVING_FROM_ONE = 12
     RECEIVING_FROM_BOTH = 13
+    PERFORMANCE_NOT_MET = 14
 
 def log_message(message, verbosity):
     if verbosity:
@@ -48,3 +54,129 @@ def log_message(message, verbosity):
 
 def no_check(child_sub, samples_sent, timeout):
     return ReturnCode.OK
+
+def parse_performance_report(output: str) -> dict:
+    """ Metrics of the reports that a shape_main application prints when it
+        finishes: the throughput of the Publisher or the Subscriber and,
+        with --perf-type, the samples lost, reordered and duplicated (per
+        writer and per instance) and the one-way latency
+        percentiles (in us) of the Subscriber, the samples per take call and
+        the cpu per sample of the Subscriber, the resident memory the
+        entities took and grew, and the allocations per sample, if counted.
+        Metrics that are not in the output are not in the result.
+    """
+    metrics = {}
+    throughput = re.search(r'(?:Publisher|Subscriber) throughput: ([0-9.]+) '
+            r'samples/s, ([0-9.]+) MB/s \(([0-9]+) samples', output)
+    if throughput:
+        metrics['throughput_samples_per_s'] = float(throughput.group(1))
+        metrics['throughput_mb_per_s'] = float(throughput.group(2))
+        metrics['samples'] = int(throughput.group(3))
+
+    writers = re.findall(r'writer [0-9]+: received ([0-9]+) lost ([0-9]+) '
+            r'reordered ([0-9]+) duplicated ([0-9]+)', output)
+    if writers:
+        received = sum(int(element[0]) for element in writers)
+        lost = sum(int(element[1]) for element in writers)
+        metrics['samples_lost'] = lost
+        metrics['loss_ratio'] = lost / (received + lost) if received + lost > 0 else 0.0
+        metrics['samples_reordered'] = sum(int(element[2]) for element in writers)
+        metrics['samples_duplicated'] = sum(int(element[3]) for element in writers)
+
+    instances = re.findall(r'instance \S+: received ([0-9]+) lost ([0-9]+) '
+            r'reordered ([0-9]+) duplicated ([0-9]+)', output)
+    if instances:
+        metrics['instance_samples_lost'] = sum(int(element[1]) for element in instances)
+        metrics['instance_samples_reordered'] = sum(int(element[2]) for element in instances)
+        metrics['instance_samples_duplicated'] = sum(int(element[3]) for element in instances)
+
+    latency = re.search(r'One-way latency \(us\): samples [0-9]+ min [0-9.]+ '
+            r'mean ([0-9.]+) p50 ([0-9.]+) p90 ([0-9.]+) p99 ([0-9.]+) '
+            r'p99.9 ([0-9.]+) max ([0-9.]+)', output)
+    if latency:
+        for index, name in enumerate(['mean', 'p50', 'p90', 'p99', 'p99.9', 'max']):
+            metrics[f'latency_{name}_us'] = float(latency.group(index + 1))
+
+    take = re.search(r'Take cost: \S+, ([0-9.]+) samples per call, up to [0-9]+ '
+            r'calls per pass, ([0-9.]+) us cpu per sample', output)
+    if take:
+        metrics['take_samples_per_call'] = float(take.group(1))
+        metrics['take_cpu_per_sample_us'] = float(take.group(2))
+
+    memory = re.search(r'Process memory \(kB resident\): start=([0-9]+) participant=([-+0-9]+) '
+            r'endpoints=([-+0-9]+) end=([-+0-9]+)', output)
+    if memory:
+        metrics['memory_participant_kb'] = int(memory.group(2))
+        metrics['memory_endpoints_kb'] = int(memory.group(3))
+        metrics['memory_growth_kb'] = int(memory.group(4))
+
+    # only printed by applications built with SHAPE_COUNT_ALLOCATIONS
+    allocations = re.search(r'Allocations per sample: \S+ ([0-9.]+) \([0-9.]+ bytes\), '
+            r'application ([0-9.]+) \([0-9.]+ bytes\), process ([0-9.]+)', output)
+    if allocations:
+        for index, name in enumerate(['middleware', 'application', 'process']):
+            metrics[f'{name}_allocations_per_sample'] = float(allocations.group(index + 1))
+    return metrics
+
+
+class ResourceMonitor:
+    """ Samples /proc/<pid> of a running shape_main application every
+        'period' seconds, in a thread, until stop() is called. On systems
+        without /proc nothing is sampled.
+
+        stop() returns what the process cost, the figures that could not be
+        sampled are not in the result:
+            * cpu_user_s, cpu_system_s: cpu time in user and kernel mode.
+            * rss_peak_kb: highest resident set size (VmHWM).
+            * rss_steady_kb: resident set size when it was last sampled,
+              i.e. once the application has created all its entities and
+              sent or received for a while.
+            * voluntary_ctxt_switches, involuntary_ctxt_switches: context
+              switches because the process waited or was preempted.
+            * threads: highest number of threads.
+    """
+    def __init__(self, pid: int, period: float = 0.1):
+        self.pid = pid
+        self.period = period
+        self.usage = {}
+        self.stopped = threading.Event()
+        self.thread = threading.Thread(target=self.run, daemon=True)
+        self.thread.start()
+
+    def run(self):
+        while self.sample():
+            if self.stopped.wait(self.period):
+                break
+
+    def sample(self) -> bool:
+        """ Updates the usage with the current figures of the process and
+            returns False once the process does not exist anymore.
+        """
+        try:
+            with open(f'/proc/{self.pid}/stat') as file:
+                # the fields after the name of the executable, which is
+                # between parentheses and may contain spaces
+                stat = file.read().rsplit(')', 1)[1].split()
+            with open(f'/proc/{self.pid}/status') as file:
+                status = dict(line.split(':', 1) for line in file if ':' in line)
+        except (OSError, IndexError, ValueError):
+            return False
+        if stat[0] == 'Z':  # zombie: its memory is already released
+            return False
+        clock_ticks = os.sysconf('SC_CLK_TCK')
+        self.usage['cpu_user_s'] = int(stat[11]) / clock_ticks
+        self.usage['cpu_system_s'] = int(stat[12]) / clock_ticks
+        self.usage['threads'] = max(int(stat[17]), self.usage.get('threads', 0))
+        for name, field in [('rss_peak_kb', 'VmHWM'),
+                ('rss_steady_kb', 'VmRSS'),
+                ('voluntary_ctxt_switches', 'voluntary_ctxt_switches'),
+                ('involuntary_ctxt_switches', 'nonvoluntary_ctxt_switches')]:
+            if field in status:
+                self.usage[name] = int(status[field].split()[0])
+        return True
+
+    def stop(self) -> dict:
+        self.stopped.set()
+        self.thread.join()
+        self.sample()
+        return self.usage
@@ -9,15 +9,42 @@
 #include <fastdds/dds/subscriber/DataReaderListener.hpp>
 #include <fastdds/dds/subscriber/qos/DataReaderQos.hpp>
 #include <fastdds/dds/subscriber/SampleInfo.hpp>
+#include <fastdds/dds/subscriber/ReadCondition.hpp>
+#include <fastdds/dds/core/condition/WaitSet.hpp>
 #include <fastdds/dds/topic/TypeSupport.hpp>
+#include <fastrtps/utils/IPLocator.h>
+#include <fastdds/rtps/transport/UDPv4TransportDescriptor.h>
+#include <fastdds/rtps/transport/TCPv4TransportDescriptor.h>
+#include <fastdds/rtps/transport/shared_mem/SharedMemTransportDescriptor.h>
+#include <fastdds/rtps/flowcontrol/FlowControllerDescriptor.hpp>
 
 #include "GeneratedCode/shape.h"
 #include "GeneratedCode/shapePubSubTypes.h"
 #include "GeneratedCode/shapeTypeObject.h"
+#include "GeneratedCode/shape_perf.h"
+#include "GeneratedCode/shape_perfPubSubTypes.h"
+#include "GeneratedCode/shape_perfTypeObject.h"
 
 #define LISTENER_STATUS_MASK_ALL StatusMask::all()
 #define LISTENER_STATUS_MASK_NONE StatusMask::none()
-#define REGISTER_TYPE registershapeTypes(); TypeSupport ts(new ShapeTypePubSubType()); ts->auto_fill_type_object(false); ts->auto_fill_type_information(false); ts.register_type
+#define DECLARE_TYPE_TRAITS(TYPE)                                           \
+struct TYPE##Traits {                                                       \
+    typedef TYPE               Type;                                        \
+    FASTDDS_CONST_SEQUENCE(Seq, TYPE);                                      \
+    typedef DDS::DataReader    DataReader;                                  \
+    typedef DDS::DataWriter    DataWriter;                                  \
+    static const char *type_name() { return #TYPE; }                        \
+    static void initialize(TYPE *) { }                                      \
+    static DDS::ReturnCode_t register_type(DDS::DomainParticipant *dp)      \
+    {                                                                       \
+        registershapeTypes();                                               \
+        registershape_perfTypes();                                          \
+        DDS::TypeSupport ts(new TYPE##PubSubType());                        \
+        ts->auto_fill_type_object(false);                                   \
+        ts->auto_fill_type_information(false);                              \
+        return ts.register_type(dp, #TYPE);                                 \
+    }                                                                       \
+};
 #define STRING_ASSIGN(field, value) field() = value
 #define STRING_IN .c_str()
 #define NAME_ACCESSOR .c_str()
@@ -25,10 +52,32 @@
 #define GET_TOPIC_DESCRIPTION(dr) const_cast<TopicDescription*>(dr->get_topicdescription())
 #define ADD_PARTITION(field, value) field().push_back(value)
 #define SECONDS_FIELD_NAME seconds
+#define SEQUENCE_LENGTH(seq) (seq).size()
+#define SEQUENCE_RESIZE(seq, len) (seq).resize(len)
+#define SEQUENCE_BUFFER(seq) (seq).data()
+/* Only plain types can be loaned (--loan runs with ShapePlainType), and the
+ * loan is zero-copy towards the local readers through data-sharing */
+#define LOAN_SAMPLE(dw, sample) dw->loan_sample(reinterpret_cast<void *&>(sample), \
+        DDS::DataWriter::LoanInitializationKind::CONSTRUCTED_LOAN_INITIALIZATION)
+#define DISCARD_LOANED_SAMPLE(dw, sample) dw->discard_loan(reinterpret_cast<void *&>(sample))
+#define CONFIGURE_DATA_SHARING(qos) (qos).data_sharing().automatic()
 
-#define ShapeTypeDataReader DataReader
-#define ShapeTypeDataWriter DataWriter
 #define StringSeq std::vector<std::string>
+#define CONFIGURE_PARTICIPANT_DISCOVERY(qos, peers, announcement_period_ms, no_multicast, transport) \
+    configure_discovery(qos, peers, announcement_period_ms, no_multicast, transport)
+#define CONFIGURE_PARTICIPANT_TRANSPORT(qos, transport, domain_id, tcp_port, tcp_server) \
+    configure_transport(qos, transport, tcp_port > 0 ? tcp_port : 5100 + domain_id, tcp_server)
+#define CONFIGURE_PREALLOCATION(qos) configure_preallocation(qos)
+/* No batching: the asynchronous thread gathers the pending samples of
+ * each destination into the same RTPS messages */
+#define CONFIGURE_ASYNC_PUBLISH(qos) \
+    ((qos).publish_mode().kind = DDS::ASYNCHRONOUS_PUBLISH_MODE, true)
+#define SHAPE_FLOW_CONTROLLER_NAME "shape_flow_controller"
+#define CONFIGURE_PARTICIPANT_FLOW_CONTROLLER(qos, bytes_per_period, period_ms, burst_periods) \
+    configure_flow_controller(qos, bytes_per_period, period_ms, burst_periods)
+#define CONFIGURE_FLOW_CONTROLLER(qos) \
+    ((qos).publish_mode().kind = DDS::ASYNCHRONOUS_PUBLISH_MODE, \
+     (qos).publish_mode().flow_controller_name = SHAPE_FLOW_CONTROLLER_NAME, true)
 
 namespace DDS = eprosima::fastdds::dds;
 #define RETCODE_OK ReturnCode_t::RETCODE_OK
@@ -61,3 +110,126 @@ const char* get_qos_policy_name(DDS::QosPolicyId_t policy_id)
   default: return "Unknown";
   }
 }
+
+/* The history allocates max_samples samples of the maximum serialized size
+ * of the type up front, and reallocates the ones that turn out to be too
+ * small for unbounded (ShapePerfType) samples. */
+template <typename EntityQos>
+bool configure_preallocation(EntityQos &qos)
+{
+  if (qos.resource_limits().max_samples <= 0) {
+    return false;
+  }
+  qos.endpoint().history_memory_policy =
+      eprosima::fastrtps::rtps::PREALLOCATED_WITH_REALLOC_MEMORY_MODE;
+  qos.resource_limits().allocated_samples = qos.resource_limits().max_samples;
+  return true;
+}
+
+/* Fast DDS flow controllers send up to max_bytes_per_period every period_ms
+ * and carry nothing over: a burst of several periods is approximated with
+ * the same rate over a period that many times longer. */
+bool configure_flow_controller(DDS::DomainParticipantQos &qos,
+        int bytes_per_period, int period_ms, int burst_periods)
+{
+  auto flow_controller = std::make_shared<eprosima::fastdds::rtps::FlowControllerDescriptor>();
+  flow_controller->name = SHAPE_FLOW_CONTROLLER_NAME;
+  flow_controller->scheduler = eprosima::fastdds::rtps::FlowControllerSchedulerPolicy::FIFO;
+  flow_controller->max_bytes_per_period = (int32_t)std::min<int64_t>(
+      (int64_t)bytes_per_period * burst_periods, INT32_MAX);
+  flow_controller->period_ms = (uint64_t)period_ms * burst_periods;
+  qos.flow_controllers().push_back(flow_controller);
+  return true;
+}
+
+/* Initial peers are IPv4 addresses with an optional port (address:port);
+ * the ones without a port are tried on the ports of the first participant
+ * ids. All of them are parsed before the QoS is touched, so a wrong one
+ * leaves the default discovery. With the UDPv4 transport, an explicit
+ * metatraffic unicast locator (any address, well-known port) keeps Fast DDS
+ * from adding its default multicast one; -T shm and tcp have no multicast. */
+bool configure_discovery(DDS::DomainParticipantQos &qos,
+        const std::vector<std::string> &peers, int announcement_period_ms, bool no_multicast,
+        const char *transport)
+{
+  using namespace eprosima::fastrtps::rtps;
+  std::vector<Locator_t> locators;
+  for (size_t i = 0; i < peers.size(); i++) {
+    Locator_t locator;
+    locator.kind = LOCATOR_KIND_UDPv4;
+    std::string address = peers[i];
+    const size_t colon = address.rfind(':');
+    if (colon != std::string::npos) {
+      char *port_end;
+      const long port = strtol(address.c_str() + colon + 1, &port_end, 10);
+      if (*port_end != '\0' || port <= 0 || port > 65535) {
+        return false;
+      }
+      locator.port = (uint32_t)port;
+      address.erase(colon);
+    }
+    if (!IPLocator::setIPv4(locator, address)) {
+      return false;
+    }
+    locators.push_back(locator);
+  }
+  for (size_t i = 0; i < locators.size(); i++) {
+    qos.wire_protocol().builtin.initialPeersList.push_back(locators[i]);
+  }
+  if (announcement_period_ms > 0) {
+    qos.wire_protocol().builtin.discovery_config.initial_announcements.period =
+        eprosima::fastrtps::Duration_t(announcement_period_ms / 1000,
+                (announcement_period_ms % 1000) * 1000000);
+  }
+  if (no_multicast && (transport == NULL || strcmp(transport, "udp") == 0)) {
+    Locator_t unicast;
+    unicast.kind = LOCATOR_KIND_UDPv4;
+    qos.wire_protocol().builtin.metatrafficUnicastLocatorList.push_back(unicast);
+  }
+  return true;
+}
+
+/* Replaces the builtin transports (SHM + UDPv4) by the selected one. TCP
+ * needs a server: the participant of the writers listens on tcp_port
+ * (--tcp-port, or 5100 + domain_id) and the others connect to it, on this
+ * host unless there are initial peers. */
+bool configure_transport(DDS::DomainParticipantQos &qos,
+        const std::string &transport, int tcp_port, bool tcp_server)
+{
+  using namespace eprosima::fastdds::rtps;
+  using eprosima::fastrtps::rtps::IPLocator;
+  using eprosima::fastrtps::rtps::Locator_t;
+  if (transport == "shm") {
+    qos.transport().user_transports.push_back(std::make_shared<SharedMemTransportDescriptor>());
+  }
+  else if (transport == "udp") {
+    qos.transport().user_transports.push_back(std::make_shared<UDPv4TransportDescriptor>());
+  }
+  else if (transport == "tcp") {
+    const uint16_t port = (uint16_t)tcp_port;
+    auto tcp = std::make_shared<TCPv4TransportDescriptor>();
+    if (tcp_server) {
+      tcp->add_listener_port(port);
+    }
+    else {
+      auto &peers = qos.wire_protocol().builtin.initialPeersList;
+      if (peers.empty()) {
+        Locator_t server;
+        IPLocator::setIPv4(server, 127, 0, 0, 1);
+        peers.push_back(server);
+      }
+      for (auto &peer : peers) {
+        peer.kind = LOCATOR_KIND_TCPv4;
+        if (peer.port == 0) {
+          peer.port = port;
+        }
+      }
+    }
+    qos.transport().user_transports.push_back(tcp);
+  }
+  else {
+    return false;
+  }
+  qos.transport().use_builtin_transports = false;
+  return true;
+}
@@ -1,4 +1,5 @@
 #include "GeneratedCode/ShapeTypeTypeSupportImpl.h"
+#include "GeneratedCode/shape_perfTypeSupportImpl.h"
 
 #include "dds/DCPS/Marked_Default_Qos.h"
 #include "dds/DCPS/Service_Participant.h"
@@ -8,12 +9,35 @@
 #include "dds/DCPS/transport/framework/TransportConfig_rch.h"
 #include "dds/DCPS/transport/framework/TransportRegistry.h"
 #include "dds/DCPS/transport/rtps_udp/RtpsUdp.h"
+#include "dds/DCPS/transport/rtps_udp/RtpsUdpInst.h"
+#include "dds/DCPS/transport/shmem/Shmem.h"
+#include "dds/DCPS/transport/tcp/Tcp.h"
+#include "dds/DCPS/transport/tcp/TcpInst.h"
 
 #define OBTAIN_DOMAIN_PARTICIPANT_FACTORY TheParticipantFactory
 #define LISTENER_STATUS_MASK_ALL OpenDDS::DCPS::ALL_STATUS_MASK
-#define REGISTER_TYPE org::omg::dds::demo::ShapeTypeTypeSupport_var ts = \
-    new org::omg::dds::demo::ShapeTypeTypeSupportImpl; ts->register_type
+#define DECLARE_TYPE_TRAITS(TYPE)                                           \
+struct TYPE##Traits {                                                       \
+    typedef TYPE               Type;                                        \
+    typedef TYPE##Seq          Seq;                                         \
+    typedef TYPE##DataReader   DataReader;                                  \
+    typedef TYPE##DataWriter   DataWriter;                                  \
+    static const char *type_name() { return #TYPE; }                        \
+    static void initialize(TYPE *) { }                                      \
+    static DDS::ReturnCode_t register_type(DDS::DomainParticipant *dp)      \
+    {                                                                       \
+        TYPE##TypeSupport_var ts = new TYPE##TypeSupportImpl;               \
+        return ts->register_type(dp, #TYPE);                                \
+    }                                                                       \
+};
 #define CONFIGURE_PARTICIPANT_FACTORY configure_rtps();
+#define CONFIGURE_DOMAIN_DISCOVERY(domain_id, peers, announcement_period_ms, no_multicast) \
+    configure_domain_discovery(domain_id, peers, announcement_period_ms, no_multicast)
+#define BIND_PARTICIPANT_TRANSPORT(dp, transport, no_multicast, tcp_port, tcp_server) \
+    bind_participant_transport(dp, transport, no_multicast, tcp_port, tcp_server)
+/* applied by configure_domain_discovery() and bind_participant_transport() */
+#define CONFIGURE_PARTICIPANT_DISCOVERY(qos, peers, announcement_period_ms, no_multicast, transport) true
+#define CONFIGURE_PARTICIPANT_TRANSPORT(qos, transport, domain_id, tcp_port, tcp_server) true
 #define STRING_IN .in()
 #define STRING_INOUT .inout()
 #define STRING_ALLOC(LHS, RHS) LHS = CORBA::string_alloc(RHS)
@@ -23,6 +47,8 @@ using org::omg::dds::demo::ShapeTypeSeq;
 using org::omg::dds::demo::ShapeTypeDataReader;
 using org::omg::dds::demo::ShapeTypeDataWriter;
 using org::omg::dds::demo::ShapeTypeTypeSupport;
+using org::omg::dds::demo::ShapeTypeTypeSupport_var;
+using org::omg::dds::demo::ShapeTypeTypeSupportImpl;
 
 const char* get_qos_policy_name(DDS::QosPolicyId_t policy_id)
 {
@@ -60,18 +86,95 @@ void StringSeq_push(DDS::StringSeq& string_seq, const char* elem)
   string_seq[i] = elem;
 }
 
+// The RTPS transport of the participants without -T
 void configure_rtps()
 {
   using namespace OpenDDS::DCPS;
-  using namespace OpenDDS::RTPS;
   TransportConfig_rch config =
     TransportRegistry::instance()->create_config("rtps_interop_demo");
   TransportInst_rch inst =
-    TransportRegistry::instance()->create_inst("rtps_transport","rtps_udp");
+    TransportRegistry::instance()->create_inst("rtps_transport", "rtps_udp");
   config->instances_.push_back(inst);
   TransportRegistry::instance()->global_config(config);
+}
+
+// OpenDDS attaches the discovery to a domain, not to a participant: the
+// first participant of a domain sets it up and the later ones must agree
+// on it. The initial peers are SPDP send addresses, on the SPDP port of
+// the domain (PB + DG * domain_id) unless they have one. The announcement
+// period is the SPDP resend period, as OpenDDS has no separate initial
+// announcements.
+bool configure_domain_discovery(int domain_id, const std::vector<std::string> &peers,
+        int announcement_period_ms, bool no_multicast)
+{
+  using namespace OpenDDS::DCPS;
+  using namespace OpenDDS::RTPS;
+  static std::map<int, std::string> domain_options;
+
+  std::string options = std::to_string(announcement_period_ms)
+      + (no_multicast ? " -M" : "");
+  for (size_t i = 0; i < peers.size(); i++) {
+    options += " " + peers[i];
+  }
+  std::map<int, std::string>::iterator it = domain_options.find(domain_id);
+  if (it != domain_options.end()) {
+    return it->second == options;
+  }
 
-  RtpsDiscovery_rch disc = make_rch<RtpsDiscovery>("RtpsDiscovery");
+  RtpsDiscovery_rch disc =
+    make_rch<RtpsDiscovery>("RtpsDiscovery_" + std::to_string(domain_id));
+  if (!peers.empty()) {
+    RtpsDiscoveryConfig::AddrVec send_addrs;
+    const std::string spdp_port = std::to_string(7400 + 250 * domain_id);
+    for (size_t i = 0; i < peers.size(); i++) {
+      const std::string address = (peers[i].find(':') == std::string::npos)
+          ? peers[i] + ":" + spdp_port : peers[i];
+      send_addrs.push_back(NetworkAddress(ACE_INET_Addr(address.c_str())));
+    }
+    disc->spdp_send_addrs(send_addrs);
+  }
+  if (announcement_period_ms > 0) {
+    disc->resend_period(TimeDuration::from_msec(announcement_period_ms));
+  }
+  if (no_multicast) {
+    disc->sedp_multicast(false);
+  }
   TheServiceParticipant->add_discovery(static_rchandle_cast<Discovery>(disc));
-  TheServiceParticipant->set_default_discovery(disc->key());
+  TheServiceParticipant->set_repo_domain(domain_id, disc->key());
+  domain_options[domain_id] = options;
+  return true;
+}
+
+// A transport configuration per set of transport options, bound to the
+// participants that use them. The "shm" and "tcp" transports (shmem, tcp)
+// only talk to OpenDDS. With tcp every participant accepts connections on
+// the address it announces through discovery: the one of the writers
+// ('tcp_server') on tcp_port if there is one, the others on any port.
+bool bind_participant_transport(DDS::DomainParticipant *dp, const char *transport,
+        bool no_multicast, int tcp_port, bool tcp_server)
+{
+  using namespace OpenDDS::DCPS;
+  const std::string selected = transport ? transport : "udp";
+  const char *transport_type = (selected == "shm") ? "shmem"
+      : (selected == "tcp") ? "tcp" : "rtps_udp";
+  const bool unicast = no_multicast && selected == "udp";
+  const int listen_port = (selected == "tcp" && tcp_server) ? tcp_port : 0;
+  const std::string name = "shape_" + selected + (unicast ? "_unicast" : "")
+      + (listen_port > 0 ? "_" + std::to_string(listen_port) : "");
+
+  TransportConfig_rch config = TransportRegistry::instance()->get_config(name);
+  if (config.is_nil()) {
+    config = TransportRegistry::instance()->create_config(name);
+    TransportInst_rch inst =
+      TransportRegistry::instance()->create_inst(name, transport_type);
+    if (unicast) {
+      static_rchandle_cast<RtpsUdpInst>(inst)->use_multicast_ = false;
+    }
+    if (listen_port > 0) {
+      static_rchandle_cast<TcpInst>(inst)->local_address_set_port((u_short)listen_port);
+    }
+    config->instances_.push_back(inst);
+  }
+  TransportRegistry::instance()->bind_config(config, dp);
+  return true;
 }
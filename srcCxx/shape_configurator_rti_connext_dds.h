@@ -1,8 +1,50 @@
 #include "shape.h"
 #include "shapeSupport.h"
+#include "shape_perf.h"
+#include "shape_perfSupport.h"
 #include "ndds/ndds_namespace_cpp.h"
 
 #define LISTENER_STATUS_MASK_ALL (DDS_STATUS_MASK_ALL)
+#define INSTANCE_HANDLE_EQUALS(a, b) DDS_InstanceHandle_equals(&(a), &(b))
+#define SEQUENCE_RESIZE(seq, len) (seq).ensure_length(len, len)
+#define SEQUENCE_BUFFER(seq) (seq).get_contiguous_buffer()
+/* Types generated with -unboundedSupport need a bounded sample pool */
+#define CONFIGURE_UNBOUNDED_DATAWRITER_QOS(qos) \
+    DDS::PropertyQosPolicyHelper::add_property(qos.property, \
+            "dds.data_writer.history.memory_manager.fast_pool.pool_buffer_max_size", \
+            "4096", DDS_BOOLEAN_FALSE)
+#define CONFIGURE_UNBOUNDED_DATAREADER_QOS(qos) \
+    DDS::PropertyQosPolicyHelper::add_property(qos.property, \
+            "dds.data_reader.history.memory_manager.fast_pool.pool_buffer_max_size", \
+            "4096", DDS_BOOLEAN_FALSE)
+#define CONFIGURE_PARTICIPANT_DISCOVERY(qos, peers, announcement_period_ms, no_multicast, transport) \
+    configure_discovery(qos, peers, announcement_period_ms, no_multicast)
+#define CONFIGURE_PARTICIPANT_TRANSPORT(qos, transport, domain_id, tcp_port, tcp_server) \
+    configure_transport(qos, transport)
+#define CONFIGURE_PREALLOCATION(qos) configure_preallocation(qos)
+#define CONFIGURE_BATCHING(qos, max_samples, flush_ms) \
+    configure_batching(qos, max_samples, flush_ms)
+#define CONFIGURE_ASYNC_PUBLISH(qos) \
+    ((qos).publish_mode.kind = DDS::ASYNCHRONOUS_PUBLISH_MODE_QOS, true)
+#define SHAPE_FLOW_CONTROLLER_NAME "dds.flow_controller.token_bucket.shape_flow_controller"
+#define CONFIGURE_PARTICIPANT_FLOW_CONTROLLER(qos, bytes_per_period, period_ms, burst_periods) \
+    configure_flow_controller(qos, bytes_per_period, period_ms, burst_periods)
+#define CONFIGURE_FLOW_CONTROLLER(qos) \
+    ((qos).publish_mode.kind = DDS::ASYNCHRONOUS_PUBLISH_MODE_QOS, \
+     DDS_String_replace(&(qos).publish_mode.flow_controller_name, SHAPE_FLOW_CONTROLLER_NAME), true)
+#define DECLARE_TYPE_TRAITS(TYPE)                                           \
+struct TYPE##Traits {                                                       \
+    typedef TYPE               Type;                                        \
+    typedef TYPE##Seq          Seq;                                         \
+    typedef TYPE##DataReader   DataReader;                                  \
+    typedef TYPE##DataWriter   DataWriter;                                  \
+    static const char *type_name() { return #TYPE; }                        \
+    static void initialize(TYPE *sample) { TYPE##_initialize(sample); }     \
+    static DDS::ReturnCode_t register_type(DDS::DomainParticipant *dp)      \
+    {                                                                       \
+        return TYPE##TypeSupport::register_type(dp, #TYPE);                 \
+    }                                                                       \
+};
 
 void StringSeq_push(DDS::StringSeq  &string_seq, const char *elem)
 {
@@ -10,6 +52,113 @@ void StringSeq_push(DDS::StringSeq  &string_seq, const char *elem)
     string_seq[string_seq.length()-1] = DDS_String_dup(elem);
 }
 
+/* The initial peers replace the default ones (which include the multicast
+ * address), and the participant sends its initial announcements
+ * 'announcement_period_ms' apart. Without multicast, neither discovery nor
+ * user data listen on multicast addresses. */
+bool configure_discovery(DDS::DomainParticipantQos &qos,
+        const std::vector<std::string> &peers, int announcement_period_ms, bool no_multicast)
+{
+    if (!peers.empty()) {
+        qos.discovery.initial_peers.length(0);
+        for (size_t i = 0; i < peers.size(); i++) {
+            StringSeq_push(qos.discovery.initial_peers, peers[i].c_str());
+        }
+    }
+    if (announcement_period_ms > 0) {
+        DDS::Duration_t period;
+        period.sec     = announcement_period_ms / 1000;
+        period.nanosec = (announcement_period_ms % 1000) * 1000000;
+        qos.discovery_config.min_initial_participant_announcement_period = period;
+        qos.discovery_config.max_initial_participant_announcement_period = period;
+    }
+    if (no_multicast) {
+        qos.discovery.multicast_receive_addresses.length(0);
+        DDS::PropertyQosPolicyHelper::add_property(qos.property,
+                "dds.transport.UDPv4.builtin.multicast_enabled", "0", DDS_BOOLEAN_FALSE);
+    }
+    return true;
+}
+
+/* Only the selected builtin transport; TCP is a separate plugin that
+ * needs a server address, so it is not configured here. */
+bool configure_transport(DDS::DomainParticipantQos &qos, const std::string &transport)
+{
+    if (transport == "shm") {
+        qos.transport_builtin.mask = DDS_TRANSPORTBUILTIN_SHMEM;
+    }
+    else if (transport == "udp") {
+        qos.transport_builtin.mask = DDS_TRANSPORTBUILTIN_UDPv4;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/* The initial samples and instances, allocated when the writer or reader
+ * is created, are the maximum ones (those that are finite). */
+template <typename EntityQos>
+bool configure_preallocation(EntityQos &qos)
+{
+    bool preallocated = false;
+    if (qos.resource_limits.max_samples != DDS::LENGTH_UNLIMITED) {
+        qos.resource_limits.initial_samples = qos.resource_limits.max_samples;
+        preallocated = true;
+    }
+    if (qos.resource_limits.max_instances != DDS::LENGTH_UNLIMITED) {
+        qos.resource_limits.initial_instances = qos.resource_limits.max_instances;
+        preallocated = true;
+    }
+    return preallocated;
+}
+
+/* A batch is sent when it has max_samples samples or, with flush_ms > 0,
+ * flush_ms after its first one; by default only when it is full. */
+bool configure_batching(DDS::DataWriterQos &qos, int max_samples, int flush_ms)
+{
+    qos.batch.enable         = DDS_BOOLEAN_TRUE;
+    qos.batch.max_samples    = max_samples;
+    qos.batch.max_data_bytes = DDS::LENGTH_UNLIMITED;
+    if (flush_ms > 0) {
+        qos.batch.max_flush_delay.sec     = flush_ms / 1000;
+        qos.batch.max_flush_delay.nanosec = (flush_ms % 1000) * 1000000;
+    }
+    return true;
+}
+
+/* A token bucket that adds bytes_per_period every period_ms, in tokens of
+ * about 1 KB (a single token for smaller periods), and keeps up to
+ * burst_periods periods of them while unused. The token size splits
+ * bytes_per_period evenly, rounded down, so the cap is never raised and
+ * loses less than a byte per token. */
+bool configure_flow_controller(DDS::DomainParticipantQos &qos,
+        int bytes_per_period, int period_ms, int burst_periods)
+{
+    const int tokens_per_period = std::max(1, (bytes_per_period + 512) / 1024);
+    const int bytes_per_token   = bytes_per_period / tokens_per_period;
+    const int64_t max_tokens    = std::min<int64_t>(
+            (int64_t)tokens_per_period * burst_periods, INT32_MAX);
+    const struct {
+        const char *name;
+        std::string value;
+    } properties[] = {
+        { "scheduling_policy",                     "DDS_RR_FLOW_CONTROLLER_SCHED_POLICY" },
+        { "token_bucket.bytes_per_token",          std::to_string(bytes_per_token) },
+        { "token_bucket.tokens_added_per_period",  std::to_string(tokens_per_period) },
+        { "token_bucket.max_tokens",               std::to_string(max_tokens) },
+        { "token_bucket.tokens_leaked_per_period", "0" },
+        { "token_bucket.period.sec",               std::to_string(period_ms / 1000) },
+        { "token_bucket.period.nanosec",           std::to_string((period_ms % 1000) * 1000000) },
+    };
+    for (size_t i = 0; i < sizeof(properties) / sizeof(properties[0]); i++) {
+        DDS::PropertyQosPolicyHelper::add_property(qos.property,
+                (std::string(SHAPE_FLOW_CONTROLLER_NAME ".") + properties[i].name).c_str(),
+                properties[i].value.c_str(), DDS_BOOLEAN_FALSE);
+    }
+    return true;
+}
+
 const char *get_qos_policy_name(DDS_QosPolicyId_t policy_id)
 {
     return DDS_QosPolicyId_to_string(policy_id); // not standard...
@@ -4,8 +4,29 @@
 #include "shapeTypeSupport.hh"
 #include "shapeDataReader.hh"
 #include "shapeDataWriter.hh"
+#include "shape_perf.hh"
+#include "shape_perfTypeSupport.hh"
+#include "shape_perfDataReader.hh"
+#include "shape_perfDataWriter.hh"
 
 #define LISTENER_STATUS_MASK_ALL (ALL_STATUS)
+#define SEQUENCE_LENGTH(seq) (seq).size()
+#define SEQUENCE_RESIZE(seq, len) (seq).resize(len)
+#define SEQUENCE_BUFFER(seq) (&(seq)[0])
+#define GET_SAMPLE_REJECTED_STATUS(dr, status) (dr)->get_sample_rejected_status(&(status))
+#define DECLARE_TYPE_TRAITS(TYPE)                                           \
+struct TYPE##Traits {                                                       \
+    typedef TYPE               Type;                                        \
+    typedef TYPE##PtrSeq       Seq;                                         \
+    typedef TYPE##DataReader   DataReader;                                  \
+    typedef TYPE##DataWriter   DataWriter;                                  \
+    static const char *type_name() { return #TYPE; }                        \
+    static void initialize(TYPE *) { }                                      \
+    static DDS::ReturnCode_t register_type(DDS::DomainParticipant *dp)      \
+    {                                                                       \
+        return TYPE##TypeSupport::register_type(dp, #TYPE);                 \
+    }                                                                       \
+};
 
 void StringSeq_push(DDS::StringSeq  &string_seq, const char *elem)
 {
@@ -15,7 +15,25 @@
 #include <signal.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <new>
 
 #if defined(RTI_CONNEXT_DDS)
 #include "shape_configurator_rti_connext_dds.h"
@@ -53,9 +71,228 @@
 #ifndef ADD_PARTITION
 #define ADD_PARTITION(field, value) StringSeq_push(field.name, value)
 #endif
+#ifndef SEQUENCE_LENGTH
+#define SEQUENCE_LENGTH(seq) (seq).length()
+#endif
+#ifndef SEQUENCE_RESIZE
+#define SEQUENCE_RESIZE(seq, len) (seq).length(len)
+#endif
+#ifndef SEQUENCE_BUFFER
+#define SEQUENCE_BUFFER(seq) (seq).get_buffer()
+#endif
+#ifndef CONFIGURE_UNBOUNDED_DATAWRITER_QOS
+#define CONFIGURE_UNBOUNDED_DATAWRITER_QOS(qos)
+#endif
+#ifndef CONFIGURE_UNBOUNDED_DATAREADER_QOS
+#define CONFIGURE_UNBOUNDED_DATAREADER_QOS(qos)
+#endif
+#ifndef LOAN_SAMPLE
+#define LOAN_SAMPLE(dw, sample) RETCODE_UNSUPPORTED
+#define DISCARD_LOANED_SAMPLE(dw, sample)
+#endif
+#ifndef CONFIGURE_DATA_SHARING
+#define CONFIGURE_DATA_SHARING(qos)
+#endif
+#ifndef CONFIGURE_PARTICIPANT_DISCOVERY
+#define CONFIGURE_PARTICIPANT_DISCOVERY(qos, peers, announcement_period_ms, no_multicast, transport) false
+#endif
+#ifndef CONFIGURE_PARTICIPANT_TRANSPORT
+#define CONFIGURE_PARTICIPANT_TRANSPORT(qos, transport, domain_id, tcp_port, tcp_server) false
+#endif
+#ifndef CONFIGURE_DOMAIN_DISCOVERY
+#define CONFIGURE_DOMAIN_DISCOVERY(domain_id, peers, announcement_period_ms, no_multicast) true
+#endif
+#ifndef BIND_PARTICIPANT_TRANSPORT
+#define BIND_PARTICIPANT_TRANSPORT(dp, transport, no_multicast, tcp_port, tcp_server) true
+#endif
+#ifndef INSTANCE_HANDLE_EQUALS
+#define INSTANCE_HANDLE_EQUALS(a, b) ((a) == (b))
+#endif
+#ifndef CONFIGURE_PREALLOCATION
+#define CONFIGURE_PREALLOCATION(qos) false
+#endif
+#ifndef CONFIGURE_BATCHING
+#define CONFIGURE_BATCHING(qos, max_samples, flush_ms) false
+#endif
+#ifndef CONFIGURE_ASYNC_PUBLISH
+#define CONFIGURE_ASYNC_PUBLISH(qos) false
+#endif
+#ifndef CONFIGURE_PARTICIPANT_FLOW_CONTROLLER
+#define CONFIGURE_PARTICIPANT_FLOW_CONTROLLER(qos, bytes_per_period, period_ms, burst_periods) false
+#endif
+#ifndef CONFIGURE_FLOW_CONTROLLER
+#define CONFIGURE_FLOW_CONTROLLER(qos) false
+#endif
+#ifndef GET_SAMPLE_REJECTED_STATUS
+#define GET_SAMPLE_REJECTED_STATUS(dr, status) (dr)->get_sample_rejected_status(status)
+#endif
+#ifndef DECLARE_TYPE_TRAITS
+#define DECLARE_TYPE_TRAITS(TYPE)                                           \
+struct TYPE##Traits {                                                       \
+    typedef TYPE               Type;                                        \
+    typedef TYPE##Seq          Seq;                                         \
+    typedef TYPE##DataReader   DataReader;                                  \
+    typedef TYPE##DataWriter   DataWriter;                                  \
+    static const char *type_name() { return #TYPE; }                        \
+    static void initialize(TYPE *) { }                                      \
+    static DDS::ReturnCode_t register_type(DDS::DomainParticipant *dp)      \
+    {                                                                       \
+        return TYPE##TypeSupport::register_type(dp, #TYPE);                 \
+    }                                                                       \
+};
+#endif
 
 using namespace DDS;
 
+DECLARE_TYPE_TRAITS(ShapeType)
+DECLARE_TYPE_TRAITS(ShapePerfType)
+DECLARE_TYPE_TRAITS(ShapePlainType)
+
+/*************************************************************/
+/* Access to the ShapePerfType/ShapePlainType fields from code shared by
+ * all the types; for ShapeType they are no-ops.
+ */
+inline void
+set_sample_sequence(ShapeType *, uint64_t, uint64_t, uint64_t)
+{
+}
+
+inline void
+set_sample_sequence(ShapePerfType *sample, uint64_t sequence_number,
+        uint64_t instance_sequence_number, uint64_t timestamp_ns)
+{
+    sample->sequence_number FIELD_ACCESSOR  = sequence_number;
+    sample->instance_sequence_number FIELD_ACCESSOR = instance_sequence_number;
+    sample->source_timestamp FIELD_ACCESSOR = timestamp_ns;
+}
+
+inline void
+set_sample_sequence(ShapePlainType *sample, uint64_t sequence_number,
+        uint64_t instance_sequence_number, uint64_t timestamp_ns)
+{
+    sample->sequence_number FIELD_ACCESSOR  = sequence_number;
+    sample->instance_sequence_number FIELD_ACCESSOR = instance_sequence_number;
+    sample->source_timestamp FIELD_ACCESSOR = timestamp_ns;
+}
+
+inline bool
+get_sample_sequence(const ShapeType *, uint64_t *, uint64_t *, uint64_t *)
+{
+    return false;
+}
+
+inline bool
+get_sample_sequence(const ShapePerfType *sample, uint64_t *sequence_number,
+        uint64_t *instance_sequence_number, uint64_t *timestamp_ns)
+{
+    *sequence_number = sample->sequence_number FIELD_ACCESSOR;
+    *instance_sequence_number = sample->instance_sequence_number FIELD_ACCESSOR;
+    *timestamp_ns    = sample->source_timestamp FIELD_ACCESSOR;
+    return true;
+}
+
+inline bool
+get_sample_sequence(const ShapePlainType *sample, uint64_t *sequence_number,
+        uint64_t *instance_sequence_number, uint64_t *timestamp_ns)
+{
+    *sequence_number = sample->sequence_number FIELD_ACCESSOR;
+    *instance_sequence_number = sample->instance_sequence_number FIELD_ACCESSOR;
+    *timestamp_ns    = sample->source_timestamp FIELD_ACCESSOR;
+    return true;
+}
+
+inline bool
+set_sample_payload(ShapeType *, int)
+{
+    return false;
+}
+
+inline bool
+set_sample_payload(ShapePerfType *sample, int payload_size)
+{
+    SEQUENCE_RESIZE(sample->payload FIELD_ACCESSOR, payload_size);
+    if (payload_size > 0) {
+        unsigned char *buffer = (unsigned char *)SEQUENCE_BUFFER(sample->payload FIELD_ACCESSOR);
+        for (int i = 0; i < payload_size; i++) {
+            buffer[i] = (unsigned char)i;
+        }
+    }
+    return true;
+}
+
+/* The payload array always has SHAPE_PLAIN_PAYLOAD_MAX bytes, payload_size
+ * tells how many of them are in use (checked against the capacity by
+ * ShapeOptions::validate) */
+inline bool
+set_sample_payload(ShapePlainType *sample, int payload_size)
+{
+    unsigned char *buffer = (unsigned char *)&sample->payload FIELD_ACCESSOR[0];
+    sample->payload_size FIELD_ACCESSOR = payload_size;
+    for (int i = 0; i < payload_size; i++) {
+        buffer[i] = (unsigned char)i;
+    }
+    return true;
+}
+
+/* Approximate serialized size of the sample, ignoring alignment */
+inline size_t
+get_sample_size(const ShapeType *sample)
+{
+    return 4 + strlen(sample->color FIELD_ACCESSOR STRING_IN) + 1 + 3 * 4;
+}
+
+inline size_t
+get_sample_size(const ShapePerfType *sample)
+{
+    return 4 + strlen(sample->color FIELD_ACCESSOR STRING_IN) + 1 + 3 * 4 + 2 * 8
+            + 4 + SEQUENCE_LENGTH(sample->payload FIELD_ACCESSOR);
+}
+
+/* ShapePlainType is sent whole, whatever the payload_size */
+inline size_t
+get_sample_size(const ShapePlainType *sample)
+{
+    return 3 * 8 + sizeof(sample->color FIELD_ACCESSOR) + 4 * 4
+            + sizeof(sample->payload FIELD_ACCESSOR);
+}
+
+/* The color is a string, except in ShapePlainType where it is a char array */
+template <typename T>
+inline const char *
+get_sample_color(const T *sample)
+{
+    return sample->color FIELD_ACCESSOR STRING_IN;
+}
+
+inline const char *
+get_sample_color(const ShapePlainType *sample)
+{
+    return &sample->color FIELD_ACCESSOR[0];
+}
+
+template <typename T>
+inline void
+set_sample_color(T *sample, const char *color)
+{
+#ifndef STRING_ALLOC
+#define STRING_ALLOC(A, B)
+#endif
+    STRING_ALLOC(sample->color, std::strlen(color));
+#ifndef STRING_ASSIGN
+    strcpy(sample->color STRING_INOUT, color);
+#else
+    STRING_ASSIGN(sample->color, color);
+#endif
+}
+
+inline void
+set_sample_color(ShapePlainType *sample, const char *color)
+{
+    char  *buffer   = &sample->color FIELD_ACCESSOR[0];
+    size_t capacity = sizeof(sample->color FIELD_ACCESSOR);
+    strncpy(buffer, color, capacity - 1);
+    buffer[capacity - 1] = '\0';
+}
 
 
 /*************************************************************/
@@ -82,6 +319,156 @@ install_sig_handlers()
     return 0;
 }
 
+/*************************************************************/
+uint64_t
+monotonic_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*************************************************************/
+uint64_t
+thread_cpu_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*************************************************************/
+bool
+pin_current_thread(int cpu)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+/*************************************************************/
+/* Heap allocations of the process, of the application and of the vendor
+ * libraries alike, in total and per thread. Counting is built in with
+ * -DSHAPE_COUNT_ALLOCATIONS only: it interposes malloc, calloc and realloc
+ * (over the glibc ones) and replaces the global operator new and delete,
+ * which allocate through them. Aligned allocations (posix_memalign,
+ * aligned_alloc, ...) are not counted.
+ */
+struct AllocationCount {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+#ifdef SHAPE_COUNT_ALLOCATIONS
+static thread_local AllocationCount thread_allocations;
+static std::atomic<uint64_t>        process_allocations(0);
+static std::atomic<uint64_t>        process_allocation_bytes(0);
+
+static inline void
+count_allocation(size_t size)
+{
+    thread_allocations.allocations++;
+    thread_allocations.bytes += size;
+    process_allocations.fetch_add(1, std::memory_order_relaxed);
+    process_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void  __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void *ptr) noexcept               { free(ptr); }
+void operator delete[](void *ptr) noexcept             { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept       { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept     { free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept   { free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+
+static const bool COUNT_ALLOCATIONS = true;
+
+static inline AllocationCount
+thread_allocation_count()
+{
+    return thread_allocations;
+}
+
+static inline AllocationCount
+process_allocation_count()
+{
+    AllocationCount count;
+    count.allocations = process_allocations.load(std::memory_order_relaxed);
+    count.bytes       = process_allocation_bytes.load(std::memory_order_relaxed);
+    return count;
+}
+#else
+static const bool COUNT_ALLOCATIONS = false;
+
+static inline AllocationCount
+thread_allocation_count()
+{
+    AllocationCount count = { 0, 0 };
+    return count;
+}
+
+static inline AllocationCount
+process_allocation_count()
+{
+    AllocationCount count = { 0, 0 };
+    return count;
+}
+#endif
+
 enum Verbosity
 {
     ERROR=1,
@@ -163,6 +550,26 @@ public:
     }
 };
 
+/* Messages above this verbosity are removed at compile time, e.g.
+ * -DSHAPE_LOG_MAX_VERBOSITY=ERROR removes the DEBUG ones */
+#ifndef SHAPE_LOG_MAX_VERBOSITY
+#define SHAPE_LOG_MAX_VERBOSITY DEBUG
+#endif
+
+/* Logs 'message' only if 'level_verbosity' is enabled: 'message' (e.g. a
+ * concatenation of strings) is not even built otherwise */
+#define LOG_MESSAGE(message, level_verbosity) \
+    do { \
+        if (logger.enabled(level_verbosity)) { \
+            logger.log_message(message, level_verbosity); \
+        } \
+    } while (0)
+
+/* Writes each message as one line of stdout, prefixed with the CLOCK_MONOTONIC
+ * time in seconds (the clock of the --events, to correlate processes). The
+ * lines go through the stdio buffer of stdout, like the sample lines, so they
+ * keep their order with them and are not flushed one by one.
+ */
 class Logger{
 public:
     Logger(enum Verbosity v)
@@ -180,11 +587,28 @@ public:
         return verbosity_;
     }
 
-    void log_message(std::string message, enum Verbosity level_verbosity)
+    bool enabled(enum Verbosity level_verbosity) const
+    {
+        return level_verbosity <= SHAPE_LOG_MAX_VERBOSITY
+                && level_verbosity <= verbosity_;
+    }
+
+    void log_message(const std::string &message, enum Verbosity level_verbosity)
     {
-        if (level_verbosity <= verbosity_) {
-            std::cout << message << std::endl;
+        if (!enabled(level_verbosity)) {
+            return;
         }
+        uint64_t now_ns = monotonic_time_ns();
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "%llu.%06llu ",
+                (unsigned long long)(now_ns / 1000000000ull),
+                (unsigned long long)(now_ns % 1000000000ull / 1000));
+        // one line per message, also with several threads logging
+        flockfile(stdout);
+        fputs(timestamp, stdout);
+        fwrite(message.data(), 1, message.size(), stdout);
+        putc_unlocked('\n', stdout);
+        funlockfile(stdout);
     }
 
 private:
@@ -194,956 +618,4909 @@ private:
 /*************************************************************/
 Logger logger(ERROR);
 /*************************************************************/
-class ShapeOptions {
+/* Machine-readable events for the test harness, one JSON object per line
+ * on a file descriptor (e.g. a pipe) or a file:
+ *   {"time_ns":<CLOCK_MONOTONIC>,"event":"<name>","topic":"<topic>",...}
+ * Each line is formatted on the stack and written with a single write(),
+ * so lines of different threads do not interleave.
+ */
+class EventStream {
 public:
-    DomainId_t                     domain_id;
-    ReliabilityQosPolicyKind       reliability_kind;
-    DurabilityQosPolicyKind        durability_kind;
-    DataRepresentationId_t         data_representation;
-    int                            history_depth;
-    int                            ownership_strength;
-
-    char               *topic_name;
-    char               *color;
-    char               *partition;
+    EventStream()
+    {
+        fd_ = -1;
+    }
 
-    bool                publish;
-    bool                subscribe;
+    ~EventStream()
+    {
+        if (fd_ > STDERR_FILENO) {
+            close(fd_);
+        }
+    }
 
-    int                 timebasedfilter_interval;
-    int                 deadline_interval;
+    //-------------------------------------------------------------
+    // 'destination' is a file descriptor number or a file name
+    bool open(const char *destination)
+    {
+        if (fd_ > STDERR_FILENO) {
+            close(fd_);
+        }
+        char *end;
+        long fd = strtol(destination, &end, 10);
+        if (end != destination && *end == '\0') {
+            if (fd < 0 || fcntl((int)fd, F_GETFD) == -1) {
+                return false;
+            }
+            fd_ = (int)fd;
+        }
+        else {
+            fd_ = ::open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        return fd_ >= 0;
+    }
 
-    int                 da_width;
-    int                 da_height;
+    bool enabled() const
+    {
+        return fd_ >= 0;
+    }
 
-    int                 xvel;
-    int                 yvel;
-    int                 shapesize;
+    //-------------------------------------------------------------
+    // 'fields_format' formats the members after "topic", without the
+    // leading comma; strings in them must be escaped with escape()
+    void emit(const char *event, const char *topic, const char *fields_format = NULL, ...)
+    {
+        if (fd_ < 0) {
+            return;
+        }
+        char topic_escaped[256];
+        char fields[512] = "";
+        escape(topic, topic_escaped, sizeof(topic_escaped));
+        if (fields_format != NULL) {
+            va_list args;
+            va_start(args, fields_format);
+            vsnprintf(fields, sizeof(fields), fields_format, args);
+            va_end(args);
+        }
 
-    bool                print_writer_samples;
+        char line[1024];
+        int length = snprintf(line, sizeof(line),
+                "{\"time_ns\":%llu,\"event\":\"%s\",\"topic\":\"%s\"%s%s}\n",
+                (unsigned long long)monotonic_time_ns(), event, topic_escaped,
+                (fields[0] != '\0') ? "," : "", fields);
+        if (length >= (int)sizeof(line)) {
+            return;
+        }
+        ssize_t written = write(fd_, line, length);
+        (void)written;
+    }
 
-public:
     //-------------------------------------------------------------
-    ShapeOptions()
+    void sample(const char *topic, const char *color, int x, int y, int shapesize)
     {
-        domain_id           = 0;
-        reliability_kind    = RELIABLE_RELIABILITY_QOS;
-        durability_kind     = VOLATILE_DURABILITY_QOS;
-        data_representation = XCDR_DATA_REPRESENTATION;
-        history_depth       = -1;      /* means default */
-        ownership_strength  = -1;      /* means shared */
+        if (fd_ < 0) {
+            return;
+        }
+        char color_escaped[256];
+        escape(color, color_escaped, sizeof(color_escaped));
+        emit("sample", topic, "\"color\":\"%s\",\"x\":%d,\"y\":%d,\"shapesize\":%d",
+                color_escaped, x, y, shapesize);
+    }
 
-        topic_name         = NULL;
-        color              = NULL;
-        partition          = NULL;
+    //-------------------------------------------------------------
+    // JSON string contents: quotes and backslashes escaped, control
+    // characters dropped, truncated to 'size'
+    static const char *escape(const char *in, char *out, size_t size)
+    {
+        size_t n = 0;
+        for (; in != NULL && *in != '\0' && n + 2 < size; in++) {
+            if (*in == '"' || *in == '\\') {
+                out[n++] = '\\';
+                out[n++] = *in;
+            }
+            else if ((unsigned char)*in >= 0x20) {
+                out[n++] = *in;
+            }
+        }
+        out[n] = '\0';
+        return out;
+    }
 
-        publish            = false;
-        subscribe          = false;
+private:
+    int fd_;
+};
 
-        timebasedfilter_interval = 0; /* off */
-        deadline_interval        = 0; /* off */
+/*************************************************************/
+EventStream events;
+/*************************************************************/
+/* Paces the publisher on absolute deadlines of the monotonic clock, so the
+ * time spent writing does not accumulate as drift. Samples are sent in
+ * bursts of 'burst' samples, one burst every burst/rate seconds.
+ * A rate of 0 disables pacing (as fast as possible).
+ */
+class RatePacer {
+public:
+    RatePacer(double rate, int burst)
+    {
+        rate_  = rate;
+        burst_ = burst;
+        period_ns_ = period_for(rate);
+        start_ns_  = 0;
+        next_deadline_ns_ = 0;
+        deadline_pending_ = false;
+        samples_   = 0;
+        overruns_  = 0;
+        requested_rate_ = rate;
+        rate_changed_   = false;
+        wakeup_         = false;
+    }
 
-        da_width  = 240;
-        da_height = 270;
+    // 0, or a rate whose period fits in the nanoseconds of a deadline
+    static bool valid_rate(double rate)
+    {
+        return rate == 0 || (rate > 0 && 1e9 / rate < (double)UINT64_MAX);
+    }
 
-        xvel = 3;
-        yvel = 3;
-        shapesize = 20;
+    void start()
+    {
+        start_ns_ = monotonic_time_ns();
+        next_deadline_ns_ = start_ns_;
+        samples_  = 0;
+        overruns_ = 0;
+    }
 
-        print_writer_samples = false;
+    int burst()
+    {
+        return burst_;
     }
 
-    //-------------------------------------------------------------
-    ~ShapeOptions()
+    void sample_sent()
     {
-        if (topic_name)  free(topic_name);
-        if (color)       free(color);
-        if (partition)   free(partition);
+        samples_++;
     }
 
     //-------------------------------------------------------------
-    void print_usage( const char *prog )
+    // From another thread (--server): the new rate applies from the next
+    // burst on, with the schedule re-anchored to that moment
+    void set_rate(double rate)
     {
-        printf("%s: \n", prog);
-        printf("   -d <int>        : domain id (default: 0)\n");
-        printf("   -b              : BEST_EFFORT reliability\n");
-        printf("   -r              : RELIABLE reliability\n");
-        printf("   -k <depth>      : keep history depth [0: KEEP_ALL]\n");
-        printf("   -f <interval>   : set a 'deadline' with interval (seconds) [0: OFF]\n");
-        printf("   -i <interval>   : apply 'time based filter' with interval (seconds) [0: OFF]\n");
-        printf("   -s <int>        : set ownership strength [-1: SHARED]\n");
-        printf("   -t <topic_name> : set the topic name\n");
-        printf("   -c <color>      : set color to publish (filter if subscriber)\n");
-        printf("   -p <partition>  : set a 'partition' string\n");
-        printf("   -D [v|l|t|p]    : set durability [v: VOLATILE,  l: TRANSIENT_LOCAL]\n");
-        printf("                                     t: TRANSIENT, p: PERSISTENT]\n");
-        printf("   -P              : publish samples\n");
-        printf("   -S              : subscribe samples\n");
-        printf("   -x [1|2]        : set data representation [1: XCDR, 2: XCDR2]\n");
-        printf("   -w              : print Publisher's samples\n");
-        printf("   -z <int>        : set shapesize (between 10-99)\n");
-        printf("   -v [e|d]        : set log message verbosity [e: ERROR, d: DEBUG]\n");
+        requested_rate_.store(rate);
+        rate_changed_.store(true);
+        wake();
+    }
+
+    // From another thread: makes wait_next_burst() return early
+    void wake()
+    {
+        wakeup_.store(true);
     }
 
     //-------------------------------------------------------------
-    bool validate() {
-        if (topic_name == NULL) {
-            logger.log_message("please specify topic name [-t]", Verbosity::ERROR);
-            return false;
+    // Blocks until the deadline of the next burst. When we are more than a
+    // full period late the schedule is re-anchored to 'now' instead of
+    // sending back-to-back bursts to catch up.
+    // Returns false when woken up before the deadline; the next call keeps
+    // waiting for the same deadline.
+    bool wait_next_burst()
+    {
+        if (rate_changed_.exchange(false)) {
+            rate_      = requested_rate_.load();
+            period_ns_ = period_for(rate_);
+            next_deadline_ns_ = monotonic_time_ns();
+            deadline_pending_ = false;
         }
-        if ( (!publish) && (!subscribe) ) {
-            logger.log_message("please specify publish [-P] or subscribe [-S]", Verbosity::ERROR);
-            return false;
+        if (period_ns_ == 0) {
+            return true;
         }
-        if ( publish && subscribe ) {
-            logger.log_message("please specify only one of: publish [-P] or subscribe [-S]", Verbosity::ERROR);
-            return false;
+        if (!deadline_pending_) {
+            next_deadline_ns_ += period_ns_;
+            uint64_t now = monotonic_time_ns();
+            if (now >= next_deadline_ns_) {
+                if (now - next_deadline_ns_ > period_ns_) {
+                    next_deadline_ns_ = now;
+                    overruns_++;
+                }
+                return true;
+            }
+            deadline_pending_ = true;
         }
-        if (publish && (color == NULL) ) {
-            color = strdup("BLUE");
-            logger.log_message("warning: color was not specified, defaulting to \"BLUE\"", Verbosity::ERROR);
+        // long periods are slept in slices, so that wake() is noticed
+        while (!all_done) {
+            uint64_t now = monotonic_time_ns();
+            if (now >= next_deadline_ns_) {
+                break;
+            }
+            if (wakeup_.exchange(false)) {
+                return false;
+            }
+            uint64_t wakeup_ns = std::min(next_deadline_ns_, now + MAX_SLEEP_NS);
+            struct timespec deadline;
+            deadline.tv_sec  = (time_t)(wakeup_ns / 1000000000ull);
+            deadline.tv_nsec = (long)(wakeup_ns % 1000000000ull);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
         }
+        deadline_pending_ = false;
         return true;
     }
 
+    void print_report()
+    {
+        double elapsed = (monotonic_time_ns() - start_ns_) / 1e9;
+        double achieved = (elapsed > 0) ? samples_ / elapsed : 0;
+        if (rate_ > 0) {
+            printf("Publisher rate: target %.1f samples/s, achieved %.1f samples/s "
+                    "(%llu samples in %.3f s, burst %d, %llu overruns)\n",
+                    rate_, achieved, (unsigned long long)samples_, elapsed,
+                    burst_, (unsigned long long)overruns_);
+        } else {
+            printf("Publisher rate: target unlimited, achieved %.1f samples/s "
+                    "(%llu samples in %.3f s)\n",
+                    achieved, (unsigned long long)samples_, elapsed);
+        }
+    }
+
+private:
+    // a burst that would wait longer than UINT64_MAX ns waits that long
+    uint64_t period_for(double rate) const
+    {
+        if (!(rate > 0)) {
+            return 0;
+        }
+        double period_ns = 1e9 * burst_ / rate;
+        return (period_ns < (double)UINT64_MAX) ? (uint64_t)period_ns : UINT64_MAX;
+    }
+
+    static const uint64_t MAX_SLEEP_NS = 100000000ull;
+
+    double   rate_;
+    int      burst_;
+    uint64_t period_ns_;
+    uint64_t start_ns_;
+    uint64_t next_deadline_ns_;
+    bool     deadline_pending_;
+    uint64_t samples_;
+    uint64_t overruns_;
+
+    std::atomic<double> requested_rate_;
+    std::atomic<bool>   rate_changed_;
+    std::atomic<bool>   wakeup_;
+};
+
+/*************************************************************/
+/* High-dynamic-range histogram of latencies in nanoseconds, following the
+ * HdrHistogram layout: values are grouped in power-of-two buckets, each
+ * split in SUB_BUCKET_COUNT linear sub-buckets, which keeps 3 significant
+ * digits from 1 ns up to MAX_VALUE_NS with a fixed, preallocated table.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram()
+        : counts_((BUCKET_COUNT + 1) * SUB_BUCKET_HALF_COUNT, 0)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_count_ = 0;
+        total_sum_   = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    void record(uint64_t value_ns)
+    {
+        if (value_ns > MAX_VALUE_NS) {
+            value_ns = MAX_VALUE_NS;
+        }
+        counts_[counts_index(value_ns)]++;
+        total_count_++;
+        total_sum_ += value_ns;
+        if (value_ns < min_) min_ = value_ns;
+        if (value_ns > max_) max_ = value_ns;
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size(); i++) {
+            counts_[i] += other.counts_[i];
+        }
+        total_count_ += other.total_count_;
+        total_sum_   += other.total_sum_;
+        if (other.min_ < min_) min_ = other.min_;
+        if (other.max_ > max_) max_ = other.max_;
+    }
+
+    uint64_t count() const
+    {
+        return total_count_;
+    }
+
     //-------------------------------------------------------------
-    bool parse(int argc, char *argv[])
+    // Smallest recorded value such that 'percentile' % of the samples
+    // are less than or equal to it (within the histogram precision).
+    uint64_t percentile(double percentile) const
     {
-        int opt;
-        bool parse_ok = true;
-        // double d;
-        while ((opt = getopt(argc, argv, "hbrc:d:D:f:i:k:p:s:x:t:v:z:wPS")) != -1)
+        if (total_count_ == 0) {
+            return 0;
+        }
+        uint64_t target = (uint64_t)(percentile / 100.0 * total_count_ + 0.5);
+        if (target < 1) target = 1;
+        uint64_t accumulated = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            accumulated += counts_[i];
+            if (accumulated >= target) {
+                uint64_t value = highest_equivalent_value(i);
+                return (value > max_) ? max_ : value;
+            }
+        }
+        return max_;
+    }
+
+    void print_report(const char *title) const
+    {
+        if (total_count_ == 0) {
+            printf("%s latency (us): no samples\n", title);
+            return;
+        }
+        printf("%s latency (us): samples %llu min %.1f mean %.1f p50 %.1f p90 %.1f "
+                "p99 %.1f p99.9 %.1f max %.1f\n",
+                title,
+                (unsigned long long)total_count_,
+                min_ / 1e3,
+                (double)total_sum_ / total_count_ / 1e3,
+                percentile(50.0) / 1e3,
+                percentile(90.0) / 1e3,
+                percentile(99.0) / 1e3,
+                percentile(99.9) / 1e3,
+                max_ / 1e3);
+    }
+
+private:
+    static const int      SUB_BUCKET_HALF_COUNT_MAGNITUDE = 10;
+    static const uint64_t SUB_BUCKET_HALF_COUNT = 1ull << SUB_BUCKET_HALF_COUNT_MAGNITUDE;
+    static const uint64_t SUB_BUCKET_MASK = (SUB_BUCKET_HALF_COUNT << 1) - 1;
+    static const int      BUCKET_COUNT = 30;
+    static const uint64_t MAX_VALUE_NS = (SUB_BUCKET_HALF_COUNT << BUCKET_COUNT) - 1;
+
+    static size_t counts_index(uint64_t value)
+    {
+        int pow2_ceiling = 64 - __builtin_clzll(value | SUB_BUCKET_MASK);
+        int bucket_index = pow2_ceiling - (SUB_BUCKET_HALF_COUNT_MAGNITUDE + 1);
+        uint64_t sub_bucket_index = value >> bucket_index;
+        return ((size_t)(bucket_index + 1) << SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+                + (size_t)(sub_bucket_index - SUB_BUCKET_HALF_COUNT);
+    }
+
+    static uint64_t highest_equivalent_value(size_t index)
+    {
+        int bucket_index = (int)(index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+        uint64_t sub_bucket_index = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+        if (bucket_index < 0) {
+            sub_bucket_index -= SUB_BUCKET_HALF_COUNT;
+            bucket_index = 0;
+        }
+        uint64_t lowest = sub_bucket_index << bucket_index;
+        return lowest + ((1ull << bucket_index) - 1);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_count_;
+    uint64_t total_sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+/*************************************************************/
+/* Counts samples and bytes between the first and the last sample to report
+ * samples/s and MB/s (1 MB = 10^6 bytes).
+ */
+class ThroughputMeter {
+public:
+    ThroughputMeter()
+    {
+        samples_  = 0;
+        bytes_    = 0;
+        first_bytes_ = 0;
+        first_ns_ = 0;
+        last_ns_  = 0;
+    }
+
+    //-------------------------------------------------------------
+    void sample(size_t bytes)
+    {
+        uint64_t now_ns = monotonic_time_ns();
+        if (samples_ == 0) {
+            first_ns_    = now_ns;
+            first_bytes_ = bytes;
+        }
+        last_ns_ = now_ns;
+        samples_++;
+        bytes_ += bytes;
+    }
+
+    uint64_t samples() const
+    {
+        return samples_;
+    }
+
+    //-------------------------------------------------------------
+    void merge(const ThroughputMeter &other)
+    {
+        if (other.samples_ == 0) {
+            return;
+        }
+        if (samples_ == 0 || other.first_ns_ < first_ns_) {
+            first_ns_    = other.first_ns_;
+            first_bytes_ = other.first_bytes_;
+        }
+        last_ns_  = std::max(last_ns_, other.last_ns_);
+        samples_ += other.samples_;
+        bytes_   += other.bytes_;
+    }
+
+    //-------------------------------------------------------------
+    // The rates count the samples after the first one, which only starts
+    // the interval.
+    void print_report(const char *title) const
+    {
+        double elapsed = (last_ns_ - first_ns_) / 1e9;
+        double samples_per_sec = (elapsed > 0) ? (samples_ - 1) / elapsed : 0;
+        double mbytes_per_sec  = (elapsed > 0) ? (bytes_ - first_bytes_) / elapsed / 1e6 : 0;
+        printf("%s throughput: %.1f samples/s, %.3f MB/s "
+                "(%llu samples, %llu bytes in %.3f s)\n",
+                title, samples_per_sec, mbytes_per_sec,
+                (unsigned long long)samples_, (unsigned long long)bytes_, elapsed);
+    }
+
+private:
+    uint64_t samples_;
+    uint64_t bytes_;
+    uint64_t first_bytes_;
+    uint64_t first_ns_;
+    uint64_t last_ns_;
+};
+
+/*************************************************************/
+/* Allocations per sample of a writer or reader once it is in steady state,
+ * i.e. WARMUP_NS after it starts: inside the calls to the middleware
+ * (write(), take_next_instance(), ...), in the rest of its thread (the
+ * application) and in the whole process meanwhile (the middleware threads
+ * too, and the other writers and readers). Only with SHAPE_COUNT_ALLOCATIONS,
+ * otherwise it does nothing. Only the thread of the writer or reader uses it.
+ */
+class AllocationMeter {
+public:
+    AllocationMeter()
+    {
+        steady_        = false;
+        warmup_end_ns_ = 0;
+        samples_       = 0;
+        vendor_.allocations = 0;
+        vendor_.bytes       = 0;
+    }
+
+    //-------------------------------------------------------------
+    void start()
+    {
+        warmup_end_ns_ = monotonic_time_ns() + WARMUP_NS;
+    }
+
+    //-------------------------------------------------------------
+    // Around each call to the middleware, with the samples it wrote or took
+    AllocationCount call_start()
+    {
+        return thread_allocation_count();
+    }
+
+    void call_end(const AllocationCount &start, uint64_t now_ns, size_t samples)
+    {
+        if (!COUNT_ALLOCATIONS) {
+            return;
+        }
+        if (!steady_) {
+            if (now_ns < warmup_end_ns_) {
+                return;
+            }
+            steady_        = true;
+            thread_start_  = thread_allocation_count();
+            process_start_ = process_allocation_count();
+            return;
+        }
+        AllocationCount end = thread_allocation_count();
+        vendor_.allocations += end.allocations - start.allocations;
+        vendor_.bytes       += end.bytes - start.bytes;
+        samples_            += samples;
+    }
+
+    //-------------------------------------------------------------
+    void stop()
+    {
+        thread_end_  = thread_allocation_count();
+        process_end_ = process_allocation_count();
+    }
+
+    //-------------------------------------------------------------
+    void print_report(const char *call) const
+    {
+        if (!COUNT_ALLOCATIONS) {
+            return;
+        }
+        if (!steady_ || samples_ == 0) {
+            printf("Allocations per sample: no samples after the warm-up\n");
+            return;
+        }
+        uint64_t thread_allocations = thread_end_.allocations - thread_start_.allocations;
+        uint64_t thread_bytes       = thread_end_.bytes - thread_start_.bytes;
+        printf("Allocations per sample: %s %.3f (%.1f bytes), application %.3f "
+                "(%.1f bytes), process %.3f (%.1f bytes) (%llu samples after %.1f s)\n",
+                call,
+                (double)vendor_.allocations / samples_,
+                (double)vendor_.bytes / samples_,
+                (double)(thread_allocations - vendor_.allocations) / samples_,
+                (double)(thread_bytes - vendor_.bytes) / samples_,
+                (double)(process_end_.allocations - process_start_.allocations) / samples_,
+                (double)(process_end_.bytes - process_start_.bytes) / samples_,
+                (unsigned long long)samples_, WARMUP_NS / 1e9);
+    }
+
+private:
+    static const uint64_t WARMUP_NS = 1000000000ull;
+
+    bool            steady_;
+    uint64_t        warmup_end_ns_;
+    uint64_t        samples_;
+    AllocationCount vendor_;   /* inside the calls, in steady state */
+    AllocationCount thread_start_;
+    AllocationCount thread_end_;
+    AllocationCount process_start_;
+    AllocationCount process_end_;
+};
+
+/*************************************************************/
+/* Moves many shapes of the same size at once. Positions and velocities are
+ * kept in separate arrays (structure of arrays) and updated with a
+ * branch-free kernel the compiler can vectorize, so generating thousands of
+ * instances does not load the publisher more than the middleware does.
+ */
+class ShapeSimulation {
+public:
+    ShapeSimulation(int da_width, int da_height, int shapesize)
+    {
+        int w2 = 1 + shapesize / 2;
+        x_lo_ = w2;
+        x_hi_ = da_width - w2;
+        y_lo_ = w2;
+        y_hi_ = da_height - w2;
+    }
+
+    //-------------------------------------------------------------
+    void add_shape(int32_t x, int32_t y, int32_t xvel, int32_t yvel)
+    {
+        x_.push_back(x);
+        y_.push_back(y);
+        xvel_.push_back(xvel);
+        yvel_.push_back(yvel);
+    }
+
+    //-------------------------------------------------------------
+    void step()
+    {
+        size_t   count = x_.size();
+        int32_t *x     = x_.data();
+        int32_t *y     = y_.data();
+        int32_t *xvel  = xvel_.data();
+        int32_t *yvel  = yvel_.data();
+
+        for (size_t i = 0; i < count; i++) {
+            bounce(&x[i], &xvel[i], x_lo_, x_hi_);
+        }
+        for (size_t i = 0; i < count; i++) {
+            bounce(&y[i], &yvel[i], y_lo_, y_hi_);
+        }
+    }
+
+    int32_t x(size_t i) const
+    {
+        return x_[i];
+    }
+
+    int32_t y(size_t i) const
+    {
+        return y_[i];
+    }
+
+    //-------------------------------------------------------------
+    // Moves 'pos' by 'vel' and reflects it on [lo, hi]. Same result as
+    // clamping to lo then to hi with a velocity flip for each, including
+    // the double flip when the shape is larger than the area (lo > hi).
+    static inline void bounce(int32_t *pos, int32_t *vel, int32_t lo, int32_t hi)
+    {
+        int32_t p     = *pos + *vel;
+        int32_t under = p < lo;
+        p             = under ? lo : p;
+        int32_t over  = p > hi;
+        p             = over ? hi : p;
+        *pos = p;
+        *vel = *vel * (1 - 2 * (under ^ over));
+    }
+
+private:
+    int32_t x_lo_;
+    int32_t x_hi_;
+    int32_t y_lo_;
+    int32_t y_hi_;
+
+    std::vector<int32_t> x_;
+    std::vector<int32_t> y_;
+    std::vector<int32_t> xvel_;
+    std::vector<int32_t> yvel_;
+};
+
+/*************************************************************/
+/* Accounts lost, reordered and duplicated samples from the sequence numbers
+ * of ShapePerfType: one per writer and one per instance of each writer.
+ * Each sequence keeps a sliding window over its last WINDOW_SIZE numbers: a
+ * number that leaves the window without having been received is lost, and
+ * is kept in the gaps of the sequence. A number that arrives after it left
+ * the window is only taken back from the lost ones if it is in a gap, any
+ * other one is a duplicate.
+ * Order is checked per instance and writer, which is the only order DDS
+ * guarantees when samples are taken instance by instance.
+ */
+class SampleAccounting {
+public:
+    SampleAccounting()
+    {
+        last_instance_ = instances_.end();
+    }
+
+    //-------------------------------------------------------------
+    void sample_received(const InstanceHandle_t &publication_handle,
+            const char *instance,
+            uint64_t sequence_number,
+            uint64_t instance_sequence_number)
+    {
+        size_t writer_index = find_writer(publication_handle);
+        WriterCounters &writer = writers_[writer_index];
+
+        // samples are taken instance by instance: only look the instance
+        // up (and build a std::string for it) when it changes
+        if (last_instance_ == instances_.end() || last_instance_->first != instance) {
+            last_instance_ = instances_.find(instance);
+            if (last_instance_ == instances_.end()) {
+                last_instance_ = instances_.insert(
+                        std::make_pair(std::string(instance), InstanceCounters())).first;
+            }
+        }
+        InstanceCounters &counters = last_instance_->second;
+        SequenceCounters &instance_sequence = counters.sequence(writer_index);
+
+        bool in_order = instance_sequence.received == 0
+                || instance_sequence_number > instance_sequence.highest_sequence;
+        bool writer_new   = writer.sequence.receive(sequence_number);
+        bool instance_new = instance_sequence.receive(instance_sequence_number);
+        if (writer_new && instance_new && !in_order) {
+            writer.reordered++;
+            counters.reordered++;
+        }
+    }
+
+    bool empty() const
+    {
+        return writers_.empty();
+    }
+
+    //-------------------------------------------------------------
+    void print_report(const char *topic_name) const
+    {
+        printf("Sample accounting for topic: %s\n", topic_name);
+        for (size_t i = 0; i < writers_.size(); i++) {
+            const WriterCounters &writer = writers_[i];
+            printf("    writer %zu: received %llu lost %llu reordered %llu duplicated %llu "
+                    "(sequence numbers %llu..%llu)\n",
+                    i,
+                    (unsigned long long)writer.sequence.received,
+                    (unsigned long long)writer.sequence.total_lost(),
+                    (unsigned long long)writer.reordered,
+                    (unsigned long long)writer.sequence.duplicated,
+                    (unsigned long long)writer.sequence.first_sequence,
+                    (unsigned long long)writer.sequence.highest_sequence);
+        }
+        std::map<std::string, InstanceCounters>::const_iterator it;
+        for (it = instances_.begin(); it != instances_.end(); ++it) {
+            uint64_t received = 0, lost = 0, duplicated = 0;
+            for (size_t i = 0; i < it->second.sequences.size(); i++) {
+                const SequenceCounters &sequence = it->second.sequences[i].second;
+                received   += sequence.received;
+                lost       += sequence.total_lost();
+                duplicated += sequence.duplicated;
+            }
+            printf("    instance %s: received %llu lost %llu reordered %llu duplicated %llu\n",
+                    it->first.c_str(),
+                    (unsigned long long)received,
+                    (unsigned long long)lost,
+                    (unsigned long long)it->second.reordered,
+                    (unsigned long long)duplicated);
+        }
+    }
+
+private:
+    static const uint64_t WINDOW_WORDS = 16;
+    static const uint64_t WINDOW_SIZE  = WINDOW_WORDS * 64;
+
+    struct SequenceCounters {
+        SequenceCounters()
         {
-            switch (opt)
-            {
-            case 'v':
-                {
-                    if (optarg[0] != '\0')
-                    {
-                        switch (optarg[0])
-                        {
-                        case 'd':
-                            {
-                                logger.verbosity(DEBUG);
-                                break;
-                            }
-                        case 'e':
-                            {
-                                logger.verbosity(ERROR);
-                                break;
-                            }
-                        default:
-                            {
-                                logger.log_message("unrecognized value for verbosity "
-                                                + std::string(1, optarg[0]),
-                                        Verbosity::ERROR);
-                                parse_ok = false;
-                            }
-                        }
-                    }
-                    break;
-                }
-            case 'w':
-                {
-                    print_writer_samples = true;
-                    break;
+            first_sequence = highest_sequence = 0;
+            memset(window, 0, sizeof(window));
+            received = lost = duplicated = 0;
+        }
+
+        // false: a duplicate of a sequence number already received
+        bool receive(uint64_t sequence_number)
+        {
+            if (received == 0) {
+                first_sequence   = sequence_number;
+                highest_sequence = sequence_number;
+            }
+            else if (sequence_number < first_sequence) {
+                // written before the first one received: not accounted
+                received++;
+                return true;
+            }
+            else if (sequence_number > highest_sequence) {
+                advance_window(sequence_number);
+            }
+            else if (sequence_number + WINDOW_SIZE > highest_sequence) {
+                if (is_marked(sequence_number)) {
+                    duplicated++;
+                    return false;
                 }
-            case 'b':
-                {
-                    reliability_kind = BEST_EFFORT_RELIABILITY_QOS;
-                    break;
+            }
+            else {
+                // arrived after it left the window
+                if (!fill_gap(sequence_number)) {
+                    duplicated++;
+                    return false;
                 }
-            case 'c':
-                {
-                    color = strdup(optarg);
-                    break;
+                received++;
+                return true;
+            }
+            mark(sequence_number);
+            received++;
+            return true;
+        }
+
+        // the lost ones and those that are missing in the window (yet)
+        uint64_t total_lost() const
+        {
+            uint64_t pending = 0;
+            if (received == 0) {
+                return lost;
+            }
+            uint64_t lowest = (highest_sequence >= first_sequence + WINDOW_SIZE)
+                    ? highest_sequence - WINDOW_SIZE + 1
+                    : first_sequence;
+            for (uint64_t sn = lowest; sn <= highest_sequence; sn++) {
+                if (!is_marked(sn)) {
+                    pending++;
                 }
-            case 'd':
-                {
-                    int converted_param = sscanf(optarg, "%d", &domain_id);
-                    if (converted_param == 0) {
-                        logger.log_message("unrecognized value for domain_id "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    else if (domain_id < 0) {
-                        logger.log_message("incorrect value for domain_id "
-                                        + std::to_string(domain_id),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    break;
-                }
-            case 'D':
-                {
-                if (optarg[0] != '\0')
-                {
-                    switch (optarg[0])
-                    {
-                    case 'v':
-                        {
-                            durability_kind = VOLATILE_DURABILITY_QOS;
-                            break;
-                        }
-                    case 'l':
-                        {
-                            durability_kind = TRANSIENT_LOCAL_DURABILITY_QOS;
-                            break;
-                        }
-                    case 't':
-                        {
-                            durability_kind = TRANSIENT_DURABILITY_QOS;
-                            break;
-                        }
-                    case 'p':
-                        {
-                            durability_kind = PERSISTENT_DURABILITY_QOS;
-                            break;
-                        }
-                    default:
-                        {
-                            logger.log_message("unrecognized value for durability "
-                                            + std::string(1, optarg[0]),
-                                    Verbosity::ERROR);
-                            parse_ok = false;
-                        }
-                    }
-                }
-                break;
+            }
+            return lost + pending;
+        }
+
+        uint64_t first_sequence;
+        uint64_t highest_sequence;
+        uint64_t window[WINDOW_WORDS];
+        uint64_t received;      /* without the duplicates */
+        uint64_t lost;          /* the numbers in 'gaps' */
+        uint64_t duplicated;
+        std::map<uint64_t, uint64_t> gaps;  /* first -> last lost sequence number */
+
+    private:
+        void mark(uint64_t sequence_number)
+        {
+            uint64_t bit = sequence_number % WINDOW_SIZE;
+            window[bit / 64] |= (1ull << (bit % 64));
+        }
+
+        void unmark(uint64_t sequence_number)
+        {
+            uint64_t bit = sequence_number % WINDOW_SIZE;
+            window[bit / 64] &= ~(1ull << (bit % 64));
+        }
+
+        bool is_marked(uint64_t sequence_number) const
+        {
+            uint64_t bit = sequence_number % WINDOW_SIZE;
+            return (window[bit / 64] & (1ull << (bit % 64))) != 0;
+        }
+
+        // The numbers leave the window in order: a new gap can only
+        // extend the last one.
+        void add_gap(uint64_t first, uint64_t last)
+        {
+            lost += last - first + 1;
+            if (!gaps.empty()) {
+                std::map<uint64_t, uint64_t>::iterator it = --gaps.end();
+                if (it->second + 1 == first) {
+                    it->second = last;
+                    return;
                 }
-            case 'i':
-                {
-                    int converted_param = sscanf(optarg, "%d", &timebasedfilter_interval);
-                    if (converted_param == 0) {
-                        logger.log_message("unrecognized value for timebasedfilter_interval "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    else if (timebasedfilter_interval < 0) {
-                        logger.log_message("incorrect value for timebasedfilter_interval "
-                                        + std::to_string(timebasedfilter_interval),
-                                Verbosity::ERROR);
-                        parse_ok = false;
+            }
+            gaps[first] = last;
+        }
+
+        // Takes a late arrival out of the gaps; false if it was not in one
+        bool fill_gap(uint64_t sequence_number)
+        {
+            std::map<uint64_t, uint64_t>::iterator it = gaps.upper_bound(sequence_number);
+            if (it == gaps.begin()) {
+                return false;
+            }
+            --it;
+            uint64_t first = it->first;
+            uint64_t last  = it->second;
+            if (sequence_number > last) {
+                return false;
+            }
+            gaps.erase(it);
+            if (first < sequence_number) {
+                gaps[first] = sequence_number - 1;
+            }
+            if (sequence_number < last) {
+                gaps[sequence_number + 1] = last;
+            }
+            lost--;
+            return true;
+        }
+
+        // Slides the window so that it ends at 'sequence_number', moving the
+        // sequence numbers that leave it unreceived to the gaps.
+        void advance_window(uint64_t sequence_number)
+        {
+            uint64_t gap = sequence_number - highest_sequence;
+            if (gap >= WINDOW_SIZE) {
+                uint64_t lowest = (highest_sequence >= first_sequence + WINDOW_SIZE)
+                        ? highest_sequence - WINDOW_SIZE + 1
+                        : first_sequence;
+                for (uint64_t sn = lowest; sn <= highest_sequence; sn++) {
+                    if (!is_marked(sn)) {
+                        add_gap(sn, sn);
                     }
-                    break;
                 }
-            case 'f':
-                {
-                    int converted_param = sscanf(optarg, "%d", &deadline_interval);
-                    if (converted_param == 0) {
-                        logger.log_message("unrecognized value for deadline_interval "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    } else if (deadline_interval < 0) {
-                        logger.log_message("incorrect value for deadline_interval "
-                                        + std::to_string(deadline_interval),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    break;
+                if (gap > WINDOW_SIZE) {
+                    add_gap(highest_sequence + 1, sequence_number - WINDOW_SIZE);
                 }
-            case 'k':
-                {
-                    int converted_param = sscanf(optarg, "%d", &history_depth);
-                    if (converted_param == 0){
-                        logger.log_message("unrecognized value for history_depth "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    } else if (history_depth < 0) {
-                        logger.log_message("incorrect value for history_depth "
-                                        + std::to_string(history_depth),
-                                Verbosity::ERROR);
-                        parse_ok = false;
+                memset(window, 0, sizeof(window));
+            }
+            else {
+                for (uint64_t sn = highest_sequence + 1; sn <= sequence_number; sn++) {
+                    // 'sn' reuses the slot of sn - WINDOW_SIZE
+                    if (sn >= first_sequence + WINDOW_SIZE && !is_marked(sn)) {
+                        add_gap(sn - WINDOW_SIZE, sn - WINDOW_SIZE);
                     }
-                    break;
-                }
-            case 'p':
-                {
-                    partition = strdup(optarg);
-                    break;
+                    unmark(sn);
                 }
-            case 'r':
-                {
-                    reliability_kind = RELIABLE_RELIABILITY_QOS;
-                    break;
-                }
-            case 's':
-                {
-                    int converted_param = sscanf(optarg, "%d", &ownership_strength);
-                    if (converted_param == 0){
-                        logger.log_message("unrecognized value for ownership_strength "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    } else if (ownership_strength < -1) {
-                        logger.log_message("incorrect value for ownership_strength "
-                                        + std::to_string(ownership_strength),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    break;
+            }
+            highest_sequence = sequence_number;
+        }
+    };
+
+    struct WriterCounters {
+        explicit WriterCounters(const InstanceHandle_t &publication_handle)
+            : handle(publication_handle)
+        {
+            reordered = 0;
+        }
+
+        InstanceHandle_t handle;
+        SequenceCounters sequence;
+        uint64_t reordered;
+    };
+
+    struct InstanceCounters {
+        InstanceCounters()
+        {
+            reordered = 0;
+        }
+
+        SequenceCounters &sequence(size_t writer_index)
+        {
+            for (size_t i = 0; i < sequences.size(); i++) {
+                if (sequences[i].first == writer_index) {
+                    return sequences[i].second;
                 }
-            case 't':
-                {
-                    topic_name = strdup(optarg);
+            }
+            sequences.push_back(std::make_pair(writer_index, SequenceCounters()));
+            return sequences.back().second;
+        }
+
+        uint64_t reordered;
+        /* the instance sequence numbers of each writer */
+        std::vector<std::pair<size_t, SequenceCounters> > sequences;
+    };
+
+    size_t find_writer(const InstanceHandle_t &publication_handle)
+    {
+        for (size_t i = 0; i < writers_.size(); i++) {
+            if (INSTANCE_HANDLE_EQUALS(writers_[i].handle, publication_handle)) {
+                return i;
+            }
+        }
+        writers_.push_back(WriterCounters(publication_handle));
+        return writers_.size() - 1;
+    }
+
+    std::vector<WriterCounters> writers_;
+    std::map<std::string, InstanceCounters> instances_;
+    std::map<std::string, InstanceCounters>::iterator last_instance_;
+};
+
+/*************************************************************/
+enum OutputMode {
+    OUTPUT_PRINT,   /* printf every sample from the endpoint thread */
+    OUTPUT_ASYNC,   /* format into a ring, printed by the flusher thread */
+    OUTPUT_COUNT    /* count samples, the flusher prints a summary per second */
+};
+
+/*************************************************************/
+enum TakeMode {
+    TAKE_INSTANCE,  /* take_next_instance(), one call and loan per instance */
+    TAKE_ALL,       /* take() of all the instances, up to take_batch samples */
+    TAKE_READ       /* read() the new samples, take() them at the end of the pass */
+};
+
+const char *
+take_call_name(TakeMode mode)
+{
+    switch (mode) {
+    case TAKE_ALL:  return "take()";
+    case TAKE_READ: return "read()";
+    default:        return "take_next_instance()";
+    }
+}
+
+/*************************************************************/
+/* The sample lines of one writer or reader. With OUTPUT_ASYNC the lines are
+ * formatted into a ring of preallocated slots, with a single producer (the
+ * endpoint thread) and a single consumer (the flusher thread), so the
+ * endpoint neither allocates nor waits on stdout. When the ring is full the
+ * line is dropped and counted instead.
+ */
+class SampleOutput {
+public:
+    SampleOutput(OutputMode mode, const std::string &label,
+            const std::string &topic_name, const std::string &printed_topic_name)
+        : mode_(mode), label_(label), topic_name_(topic_name),
+          printed_topic_name_(printed_topic_name),
+          lines_(mode == OUTPUT_ASYNC ? RING_SLOTS * LINE_SIZE : 0),
+          head_(0), tail_(0), samples_(0), dropped_(0), reported_(0)
+    {
+    }
+
+    //-------------------------------------------------------------
+    void sample(const char *color, int x, int y, int shapesize)
+    {
+        events.sample(topic_name_.c_str(), color, x, y, shapesize);
+
+        switch (mode_) {
+        case OUTPUT_PRINT:
+            printf("%-10s %-10s %03d %03d [%d]\n", printed_topic_name_.c_str(),
+                    color, x, y, shapesize);
+            break;
+        case OUTPUT_ASYNC:
+            {
+                uint64_t head = head_.load(std::memory_order_relaxed);
+                if (head - tail_.load(std::memory_order_acquire) == RING_SLOTS) {
+                    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
                     break;
                 }
-            case 'P':
-                {
-                    publish = true;
-                    break;
+                char *line = &lines_[(head % RING_SLOTS) * LINE_SIZE];
+                int length = snprintf(line, LINE_SIZE, "%-10s %-10s %03d %03d [%d]\n",
+                        printed_topic_name_.c_str(), color, x, y, shapesize);
+                if (length >= LINE_SIZE) {
+                    line[LINE_SIZE - 2] = '\n';
                 }
-            case 'S':
-                {
-                    subscribe = true;
-                    break;
+                head_.store(head + 1, std::memory_order_release);
+                break;
+            }
+        case OUTPUT_COUNT:
+            break;
+        }
+        samples_.store(samples_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+
+    //-------------------------------------------------------------
+    // Flusher thread only
+    void drain()
+    {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        uint64_t head = head_.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            fputs(&lines_[(tail % RING_SLOTS) * LINE_SIZE], stdout);
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    //-------------------------------------------------------------
+    // Flusher thread only
+    void print_summary(double elapsed)
+    {
+        uint64_t samples = samples_.load(std::memory_order_relaxed);
+        printf("%s: %llu samples, %.1f samples/s\n", label_.c_str(),
+                (unsigned long long)samples,
+                (elapsed > 0) ? (samples - reported_) / elapsed : 0);
+        reported_ = samples;
+    }
+
+    uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    const std::string &label() const
+    {
+        return label_;
+    }
+
+private:
+    static const int RING_SLOTS = 4096;
+    static const int LINE_SIZE  = 192;
+
+    OutputMode            mode_;
+    std::string           label_;
+    std::string           topic_name_;
+    std::string           printed_topic_name_; /* of the filtered topic, if any */
+    std::vector<char>     lines_;
+    std::atomic<uint64_t> head_;     /* written by the endpoint */
+    std::atomic<uint64_t> tail_;     /* written by the flusher */
+    std::atomic<uint64_t> samples_;  /* written by the endpoint */
+    std::atomic<uint64_t> dropped_;  /* written by the endpoint */
+    uint64_t              reported_; /* flusher only */
+};
+
+/*************************************************************/
+/* Owns the SampleOutput of every endpoint and, unless every sample is
+ * printed directly, runs the thread that prints them: the formatted lines
+ * every 10 ms (OUTPUT_ASYNC) or the sample counts every second
+ * (OUTPUT_COUNT).
+ */
+class OutputFlusher {
+public:
+    OutputFlusher()
+    {
+        mode_    = OUTPUT_PRINT;
+        running_ = false;
+    }
+
+    ~OutputFlusher()
+    {
+        stop();
+        for (size_t i = 0; i < outputs_.size(); i++) {
+            delete outputs_[i];
+        }
+    }
+
+    //-------------------------------------------------------------
+    void start(OutputMode mode)
+    {
+        mode_ = mode;
+        if (mode_ != OUTPUT_PRINT) {
+            running_ = true;
+            thread_  = std::thread(&OutputFlusher::run, this);
+        }
+    }
+
+    //-------------------------------------------------------------
+    // Prints what is left, so the reports that follow come after the samples
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) {
+                return;
+            }
+            running_ = false;
+        }
+        wakeup_.notify_one();
+        thread_.join();
+
+        for (size_t i = 0; i < outputs_.size(); i++) {
+            warn_dropped(outputs_[i]);
+        }
+    }
+
+    //-------------------------------------------------------------
+    SampleOutput *create_output(const std::string &label,
+            const std::string &topic_name, const std::string &printed_topic_name)
+    {
+        SampleOutput *output = new SampleOutput(mode_, label, topic_name, printed_topic_name);
+        std::lock_guard<std::mutex> lock(mutex_);
+        outputs_.push_back(output);
+        return output;
+    }
+
+    //-------------------------------------------------------------
+    // The endpoints of --server sessions go away while the flusher runs:
+    // their pending lines are printed first
+    void destroy_output(SampleOutput *output)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<SampleOutput *>::iterator it =
+                std::find(outputs_.begin(), outputs_.end(), output);
+        if (it == outputs_.end()) {
+            return;
+        }
+        outputs_.erase(it);
+        if (running_) {
+            if (mode_ == OUTPUT_ASYNC) {
+                output->drain();
+            }
+            warn_dropped(output);
+        }
+        delete output;
+    }
+
+private:
+    static void warn_dropped(SampleOutput *output)
+    {
+        if (output->dropped() > 0) {
+            LOG_MESSAGE("warning: " + output->label() + " dropped "
+                            + std::to_string(output->dropped())
+                            + " sample lines, the output could not keep up",
+                    Verbosity::ERROR);
+        }
+    }
+
+    void run()
+    {
+        uint64_t period_ns = (mode_ == OUTPUT_COUNT) ? 1000000000ull : 10000000ull;
+        uint64_t last_ns   = monotonic_time_ns();
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool running = true;
+        while (running) {
+            wakeup_.wait_for(lock, std::chrono::nanoseconds(period_ns),
+                    [this]() { return !running_; });
+            running = running_;
+            uint64_t now_ns = monotonic_time_ns();
+            for (size_t i = 0; i < outputs_.size(); i++) {
+                if (mode_ == OUTPUT_ASYNC) {
+                    outputs_[i]->drain();
                 }
-            case 'h':
-                {
-                    print_usage(argv[0]);
-                    exit(0);
-                    break;
+                else {
+                    outputs_[i]->print_summary((now_ns - last_ns) / 1e9);
                 }
-            case 'x':
+            }
+            last_ns = now_ns;
+            fflush(stdout);
+        }
+    }
+
+    OutputMode                  mode_;
+    bool                        running_;
+    std::thread                 thread_;
+    std::mutex                  mutex_;
+    std::condition_variable     wakeup_;
+    std::vector<SampleOutput *> outputs_;
+};
+
+/*************************************************************/
+OutputFlusher output_flusher;
+
+/*************************************************************/
+/* When each startup phase completed and when the application first
+ * matched, saw a writer alive and wrote or received a sample, on the
+ * monotonic clock since main() started: restarting a node costs the
+ * entity creation plus the discovery, and this is what tells vendors apart.
+ * Only the first time of each phase counts; listener threads record theirs
+ * concurrently with the application thread.
+ */
+class StartupTimes {
+public:
+    enum Phase {
+        PARTICIPANT_FACTORY,
+        PARTICIPANT,
+        REGISTER_TYPE,
+        TOPICS,
+        ENDPOINTS,
+        FIRST_MATCH,
+        FIRST_ALIVE,    /* subscriber only */
+        FIRST_SAMPLE,
+        PHASE_COUNT
+    };
+
+    StartupTimes()
+    {
+        start_ns_ = monotonic_time_ns();
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            phase_ns_[i] = 0;
+        }
+    }
+
+    //-------------------------------------------------------------
+    void start()
+    {
+        start_ns_ = monotonic_time_ns();
+    }
+
+    //-------------------------------------------------------------
+    void record(Phase phase)
+    {
+        if (phase_ns_[phase].load(std::memory_order_relaxed) != 0) {
+            return;
+        }
+        uint64_t none   = 0;
+        uint64_t now_ns = monotonic_time_ns();
+        if (phase_ns_[phase].compare_exchange_strong(none, now_ns)) {
+            events.emit("startup_phase", "", "\"phase\":\"%s\",\"elapsed_ns\":%llu",
+                    phase_name(phase), (unsigned long long)(now_ns - start_ns_));
+        }
+    }
+
+    //-------------------------------------------------------------
+    // One line of name=milliseconds, '-' for the phases never reached
+    void print_report() const
+    {
+        printf("Startup times (ms):");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            uint64_t phase_ns = phase_ns_[i].load(std::memory_order_relaxed);
+            if (phase_ns == 0) {
+                printf(" %s=-", phase_name((Phase)i));
+            }
+            else {
+                printf(" %s=%.3f", phase_name((Phase)i), (phase_ns - start_ns_) / 1e6);
+            }
+        }
+        printf("\n");
+    }
+
+private:
+    static const char *phase_name(Phase phase)
+    {
+        static const char *names[PHASE_COUNT] = {
+            "participant_factory", "participant", "register_type", "topics",
+            "endpoints", "first_match", "first_alive", "first_sample"
+        };
+        return names[phase];
+    }
+
+    uint64_t              start_ns_;
+    std::atomic<uint64_t> phase_ns_[PHASE_COUNT];
+};
+
+/*************************************************************/
+StartupTimes startup_times;
+
+/*************************************************************/
+/* Resident memory of the whole process when it starts, once the participant
+ * and once the writers and readers are created, and at the end of the run:
+ * what the entities cost when they were created (more when their resource
+ * limits are preallocated) and how much they grew while they ran. Each
+ * writer and reader also reports the growth around its own creation and
+ * sample loop, see ShapeApplication::Endpoint.
+ */
+class MemoryFootprint {
+public:
+    enum Stage {
+        START,
+        PARTICIPANT,
+        ENDPOINTS,
+        END,
+        STAGE_COUNT
+    };
+
+    MemoryFootprint()
+    {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            rss_kb_[i] = 0;
+        }
+    }
+
+    //-------------------------------------------------------------
+    void record(Stage stage)
+    {
+        uint64_t none = 0;
+        rss_kb_[stage].compare_exchange_strong(none, resident_kb());
+    }
+
+    //-------------------------------------------------------------
+    // The growth since the previous stage, '-' for the stages never reached
+    void print_report() const
+    {
+        printf("Process memory (kB resident):");
+        uint64_t previous_kb = 0;
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            uint64_t rss_kb = rss_kb_[i].load();
+            if (rss_kb == 0) {
+                printf(" %s=-", stage_name((Stage)i));
+            }
+            else if (previous_kb == 0) {
+                printf(" %s=%llu", stage_name((Stage)i), (unsigned long long)rss_kb);
+                previous_kb = rss_kb;
+            }
+            else {
+                printf(" %s=%+lld", stage_name((Stage)i), (long long)(rss_kb - previous_kb));
+                previous_kb = rss_kb;
+            }
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf(" peak=%ld\n", usage.ru_maxrss);
+    }
+
+    //-------------------------------------------------------------
+    static uint64_t resident_kb()
+    {
+        unsigned long size     = 0;
+        unsigned long resident = 0;
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (statm == NULL) {
+            return 0;
+        }
+        if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+        return (uint64_t)resident * sysconf(_SC_PAGESIZE) / 1024;
+    }
+
+private:
+    static const char *stage_name(Stage stage)
+    {
+        static const char *names[STAGE_COUNT] = {
+            "start", "participant", "endpoints", "end"
+        };
+        return names[stage];
+    }
+
+    std::atomic<uint64_t> rss_kb_[STAGE_COUNT];
+};
+
+/*************************************************************/
+MemoryFootprint memory_footprint;
+
+/*************************************************************/
+class ShapeOptions {
+public:
+    DomainId_t                     domain_id;
+    ReliabilityQosPolicyKind       reliability_kind;
+    DurabilityQosPolicyKind        durability_kind;
+    DataRepresentationId_t         data_representation;
+    int                            history_depth;
+    int                            ownership_strength;
+
+    char               *topic_name;
+    char               *color;
+    char               *partition;
+
+    bool                publish;
+    bool                subscribe;
+
+    int                 timebasedfilter_interval;
+    int                 deadline_interval;
+
+    int                 da_width;
+    int                 da_height;
+
+    int                 shapesize;
+
+    bool                print_writer_samples;
+
+    double              publish_rate;
+    int                 publish_burst;
+
+    bool                use_waitset;
+    bool                latency_ping;
+    bool                latency_echo;
+
+    bool                perf_type;
+    bool                plain_type;
+    int                 payload_size;
+
+    int                 num_instances;
+    bool                write_handle_nil;
+    bool                use_loan;
+
+    int                 num_threads;
+    bool                topic_per_thread;
+    std::vector<int>    cpus;
+
+    bool                separate_participants;
+
+    OutputMode          output_mode;
+    char               *events_destination;
+
+    std::vector<std::string> peers;
+    int                 announcement_period_ms;
+    bool                no_multicast;
+
+    char               *transport;      /* shm, udp or tcp; NULL: vendor default */
+    int                 tcp_port;       /* 0: vendor default */
+
+    bool                server;
+
+    /* ResourceLimits of the writers and readers, -1: vendor default */
+    int                 max_samples;
+    int                 max_instances;
+    int                 max_samples_per_instance;
+    bool                preallocate;
+
+    TakeMode            take_mode;
+    int                 take_batch;     /* samples per take, 0: unlimited */
+
+    int                 batch_samples;  /* samples per batch, 0: no batching */
+    int                 batch_flush_ms; /* 0: vendor default */
+    bool                async_publish;
+
+    /* flow controller of the participant, shared by its writers */
+    int                 flow_rate_kbps; /* kB/s, 0: no flow controller */
+    int                 flow_period_ms;
+    int                 flow_burst;     /* periods of tokens the bucket holds */
+
+private:
+    enum LongOption {
+        OPT_RATE = 256,
+        OPT_BURST,
+        OPT_WAITSET,
+        OPT_PING,
+        OPT_ECHO,
+        OPT_PERF_TYPE,
+        OPT_PLAIN_TYPE,
+        OPT_PAYLOAD_SIZE,
+        OPT_NUM_INSTANCES,
+        OPT_HANDLE_NIL,
+        OPT_LOAN,
+        OPT_THREADS,
+        OPT_TOPIC_PER_THREAD,
+        OPT_CPUS,
+        OPT_SEPARATE_PARTICIPANTS,
+        OPT_OUTPUT,
+        OPT_EVENTS,
+        OPT_PEER,
+        OPT_ANNOUNCEMENT_PERIOD,
+        OPT_NO_MULTICAST,
+        OPT_TCP_PORT,
+        OPT_SERVER,
+        OPT_MAX_SAMPLES,
+        OPT_MAX_INSTANCES,
+        OPT_MAX_SAMPLES_PER_INSTANCE,
+        OPT_PREALLOCATE,
+        OPT_TAKE,
+        OPT_TAKE_BATCH,
+        OPT_BATCH,
+        OPT_BATCH_FLUSH,
+        OPT_ASYNC,
+        OPT_FLOW_RATE,
+        OPT_FLOW_PERIOD,
+        OPT_FLOW_BURST,
+    };
+
+    static const int MAX_PAYLOAD_SIZE = 64 * 1024 * 1024;
+
+public:
+    //-------------------------------------------------------------
+    ShapeOptions()
+    {
+        domain_id           = 0;
+        reliability_kind    = RELIABLE_RELIABILITY_QOS;
+        durability_kind     = VOLATILE_DURABILITY_QOS;
+        data_representation = XCDR_DATA_REPRESENTATION;
+        history_depth       = -1;      /* means default */
+        ownership_strength  = -1;      /* means shared */
+
+        topic_name         = NULL;
+        color              = NULL;
+        partition          = NULL;
+
+        publish            = false;
+        subscribe          = false;
+
+        timebasedfilter_interval = 0; /* off */
+        deadline_interval        = 0; /* off */
+
+        da_width  = 240;
+        da_height = 270;
+
+        shapesize = 20;
+
+        print_writer_samples = false;
+
+        publish_rate  = 30;    /* samples per second, 0: as fast as possible */
+        publish_burst = 1;
+
+        use_waitset  = false;
+        latency_ping = false;
+        latency_echo = false;
+
+        perf_type    = false;
+        plain_type   = false;
+        payload_size = 0;
+
+        num_instances    = 1;
+        write_handle_nil = false;
+        use_loan         = false;
+
+        num_threads      = 1;
+        topic_per_thread = false;
+
+        separate_participants = false;
+
+        output_mode = OUTPUT_PRINT;
+        events_destination = NULL;
+
+        announcement_period_ms = 0;
+        no_multicast           = false;
+
+        transport = NULL;
+        tcp_port  = 0;
+
+        server = false;
+
+        max_samples              = -1;
+        max_instances            = -1;
+        max_samples_per_instance = -1;
+        preallocate              = false;
+
+        take_mode  = TAKE_INSTANCE;
+        take_batch = 0;
+
+        batch_samples  = 0;
+        batch_flush_ms = 0;
+        async_publish  = false;
+
+        flow_rate_kbps = 0;
+        flow_period_ms = 10;
+        flow_burst     = 1;
+    }
+
+    //-------------------------------------------------------------
+    ~ShapeOptions()
+    {
+        if (topic_name)  free(topic_name);
+        if (color)       free(color);
+        if (partition)   free(partition);
+        if (events_destination) free(events_destination);
+        if (transport)   free(transport);
+    }
+
+    //-------------------------------------------------------------
+    void print_usage( const char *prog )
+    {
+        printf("%s: \n", prog);
+        printf("   -d <int>        : domain id (default: 0)\n");
+        printf("   -b              : BEST_EFFORT reliability\n");
+        printf("   -r              : RELIABLE reliability\n");
+        printf("   -k <depth>      : keep history depth [0: KEEP_ALL]\n");
+        printf("   -f <interval>   : set a 'deadline' with interval (seconds) [0: OFF]\n");
+        printf("   -i <interval>   : apply 'time based filter' with interval (seconds) [0: OFF]\n");
+        printf("   -s <int>        : set ownership strength [-1: SHARED]\n");
+        printf("   -t <topic_name> : set the topic name\n");
+        printf("   -c <color>      : set color to publish (filter if subscriber)\n");
+        printf("   -p <partition>  : set a 'partition' string\n");
+        printf("   -D [v|l|t|p]    : set durability [v: VOLATILE,  l: TRANSIENT_LOCAL]\n");
+        printf("                                     t: TRANSIENT, p: PERSISTENT]\n");
+        printf("   -P              : publish samples\n");
+        printf("   -S              : subscribe samples\n");
+        printf("   -x [1|2]        : set data representation [1: XCDR, 2: XCDR2]\n");
+        printf("   -w              : print Publisher's samples\n");
+        printf("   -z <int>        : set shapesize (between 10-99)\n");
+        printf("   -v [e|d]        : set log message verbosity [e: ERROR, d: DEBUG]\n");
+        printf("   -T [shm|udp|tcp] : use only this builtin transport (default: vendor default)\n");
+        printf("   --rate <samples/s> : publish rate [0: as fast as possible] (default: 30)\n");
+        printf("   --burst <int>   : samples written back-to-back per period (default: 1)\n");
+        printf("   --waitset       : subscriber blocks on a WaitSet instead of polling every 100 ms\n");
+        printf("                     (implied by -P -S)\n");
+        printf("   --ping          : publisher measures round-trip latency against an --echo subscriber\n");
+        printf("   --echo          : subscriber writes every sample back on <topic_name>Echo\n");
+        printf("   --perf-type     : use ShapePerfType (sequence number and timestamp) to account\n");
+        printf("                     lost, reordered and duplicated samples\n");
+        printf("   --plain-type    : use ShapePlainType, the fixed-size variant of ShapePerfType\n");
+        printf("                     (char array color, octet array payload of up to %d bytes)\n",
+                SHAPE_PLAIN_PAYLOAD_MAX);
+        printf("   --payload-size <bytes>[k|m] : add an octet sequence payload to every sample\n");
+        printf("                     (implies --perf-type) (default: 0)\n");
+        printf("   --num-instances <int> : publish <color>, <color>_1, ... <color>_<int-1>\n");
+        printf("                     round-robin from one writer (default: 1)\n");
+        printf("   --handle-nil    : write with HANDLE_NIL instead of registered instance handles\n");
+        printf("   --loan          : write samples loaned from the DataWriter when the vendor\n");
+        printf("                     supports it, copy them otherwise (implies --plain-type)\n");
+        printf("   --threads <int> : number of writers (-P) or readers (-S), each on its\n");
+        printf("                     own thread (default: 1)\n");
+        printf("   --topic-per-thread : writer/reader <n> uses topic <topic_name>_<n>\n");
+        printf("                     instead of all sharing <topic_name>\n");
+        printf("   --cpus <list>   : pin thread <n> to the <n>-th cpu of the list, e.g. 0,2,4-7\n");
+        printf("   --separate-participants : with -P -S, create the writers and the readers\n");
+        printf("                     on two participants of this process (default: one)\n");
+        printf("   --output <mode> : how samples are printed: print (each from the\n");
+        printf("                     writer/reader thread), async (from a separate thread,\n");
+        printf("                     dropped if it falls behind), count (only a summary\n");
+        printf("                     per second) (default: print)\n");
+        printf("   --events <fd|file> : also write the creation, match, liveliness and\n");
+        printf("                     sample events as JSON lines to a file descriptor or file\n");
+        printf("   --peer <address> : discover participants at this unicast address\n");
+        printf("                     (address or address:port, repeat for several),\n");
+        printf("                     instead of the default peers\n");
+        printf("   --announcement-period <ms> : period of the initial participant\n");
+        printf("                     announcements (default: vendor default)\n");
+        printf("   --no-multicast  : do not use multicast, requires --peer\n");
+        printf("   --tcp-port <port> : with -T tcp, the port the participant of the writers\n");
+        printf("                     listens on and the others connect to (default: vendor\n");
+        printf("                     default)\n");
+        printf("   --server        : create and delete writers and readers on the commands\n");
+        printf("                     read from stdin, on participants kept across them\n");
+        printf("   --max-samples <int> : ResourceLimits max_samples of the writers and readers\n");
+        printf("                     [0: unlimited] (default: vendor default)\n");
+        printf("   --max-instances <int> : ResourceLimits max_instances [0: unlimited]\n");
+        printf("                     (default: vendor default)\n");
+        printf("   --max-samples-per-instance <int> : ResourceLimits max_samples_per_instance\n");
+        printf("                     [0: unlimited] (default: vendor default)\n");
+        printf("   --preallocate   : allocate the samples and instances of the resource\n");
+        printf("                     limits when the writers and readers are created\n");
+        printf("   --take <mode>   : how the readers get the samples: instance\n");
+        printf("                     (take_next_instance() of each instance), all (take()\n");
+        printf("                     of all the instances), read (read() them, take() them\n");
+        printf("                     at the end of each pass) (default: instance)\n");
+        printf("   --take-batch <int> : maximum samples per take/read call [0: unlimited]\n");
+        printf("                     (default: 0)\n");
+        printf("   --batch <int>   : writers send up to <int> samples per batch\n");
+        printf("                     (default: 0, no batching)\n");
+        printf("   --batch-flush <ms> : send a batch at most <ms> after its first\n");
+        printf("                     sample, even if it is not full (default: vendor default)\n");
+        printf("   --async         : writers publish asynchronously, from a thread of the\n");
+        printf("                     middleware (default: from the write() call)\n");
+        printf("   --flow-rate <kB/s> : writers publish asynchronously through a flow\n");
+        printf("                     controller of the participant that caps them all\n");
+        printf("                     at <kB/s> (default: 0, no flow controller)\n");
+        printf("   --flow-period <ms> : period in which the flow controller releases\n");
+        printf("                     its bytes (default: 10)\n");
+        printf("   --flow-burst <int> : periods of unused bytes the flow controller may\n");
+        printf("                     save for a burst, 1: fixed rate (default: 1)\n");
+    }
+
+    //-------------------------------------------------------------
+    bool validate() {
+        if ( server ) {
+            // the writers and readers come with the commands
+            if ( publish || subscribe ) {
+                LOG_MESSAGE("please specify publish [-P] and subscribe [-S] in the create commands of --server", Verbosity::ERROR);
+                return false;
+            }
+            return true;
+        }
+        if (topic_name == NULL) {
+            LOG_MESSAGE("please specify topic name [-t]", Verbosity::ERROR);
+            return false;
+        }
+        if ( (!publish) && (!subscribe) ) {
+            LOG_MESSAGE("please specify publish [-P] or subscribe [-S]", Verbosity::ERROR);
+            return false;
+        }
+        if ( publish && subscribe && (latency_ping || latency_echo) ) {
+            LOG_MESSAGE("please specify only one of: publish [-P] or subscribe [-S] with --ping or --echo", Verbosity::ERROR);
+            return false;
+        }
+        if ( tcp_port > 0 && (transport == NULL || strcmp(transport, "tcp") != 0) ) {
+            LOG_MESSAGE("please specify the tcp transport [-T tcp] with --tcp-port", Verbosity::ERROR);
+            return false;
+        }
+        if ( no_multicast && peers.empty() ) {
+            LOG_MESSAGE("please specify the unicast peers [--peer] with --no-multicast", Verbosity::ERROR);
+            return false;
+        }
+        if ( separate_participants && !(publish && subscribe) ) {
+            LOG_MESSAGE("please specify both publish [-P] and subscribe [-S] with --separate-participants", Verbosity::ERROR);
+            return false;
+        }
+        if ( latency_ping && !publish ) {
+            LOG_MESSAGE("please specify publish [-P] with --ping", Verbosity::ERROR);
+            return false;
+        }
+        if ( latency_echo && !subscribe ) {
+            LOG_MESSAGE("please specify subscribe [-S] with --echo", Verbosity::ERROR);
+            return false;
+        }
+        if ( (latency_ping || latency_echo) && num_threads > 1 ) {
+            LOG_MESSAGE("please specify only one thread with --ping or --echo", Verbosity::ERROR);
+            return false;
+        }
+        if (publish && (color == NULL) ) {
+            color = strdup("BLUE");
+            LOG_MESSAGE("warning: color was not specified, defaulting to \"BLUE\"", Verbosity::ERROR);
+        }
+        if ( use_loan && !plain_type ) {
+            // only fixed-size types can be loaned from the DataWriter
+            plain_type = true;
+        }
+        if ( plain_type ) {
+            if ( payload_size > SHAPE_PLAIN_PAYLOAD_MAX ) {
+                LOG_MESSAGE("please specify a payload-size of at most "
+                                + std::to_string(SHAPE_PLAIN_PAYLOAD_MAX)
+                                + " bytes with --plain-type or --loan",
+                        Verbosity::ERROR);
+                return false;
+            }
+            perf_type = true;
+        }
+        if ( publish && subscribe ) {
+            // writers and readers share the clock, so the one-way latency
+            // of the perf type is the intra-process delivery latency, as
+            // long as the readers block instead of polling every 100 ms
+            perf_type   = true;
+            use_waitset = true;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    // Comma-separated cpus or ranges of cpus: "0,2,4-7"
+    bool parse_cpu_list(const char *list)
+    {
+        cpus.clear();
+        const char *p = list;
+        while (*p != '\0') {
+            char *end;
+            long first = strtol(p, &end, 10);
+            long last  = first;
+            if (end == p || first < 0) {
+                return false;
+            }
+            p = end;
+            if (*p == '-') {
+                last = strtol(p + 1, &end, 10);
+                if (end == p + 1 || last < first) {
+                    return false;
+                }
+                p = end;
+            }
+            if (last >= CPU_SETSIZE) {
+                return false;
+            }
+            for (long cpu = first; cpu <= last; cpu++) {
+                cpus.push_back((int)cpu);
+            }
+            if (*p == ',') {
+                p++;
+            }
+            else if (*p != '\0') {
+                return false;
+            }
+        }
+        return !cpus.empty();
+    }
+
+    //-------------------------------------------------------------
+    // The cpus of --cpus, one per thread index: "0,2,4,5,6,7"
+    std::string cpu_list_string() const
+    {
+        if (cpus.empty()) {
+            return "(none)";
+        }
+        std::string list;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            list += (i > 0 ? "," : "") + std::to_string(cpus[i]);
+        }
+        return list;
+    }
+
+    //-------------------------------------------------------------
+    // The value of --max-samples, --max-instances or --max-samples-per-instance
+    static bool parse_resource_limit(const char *option, const char *value, int *limit)
+    {
+        int converted_param = 0;
+        if (sscanf(value, "%d", &converted_param) == 0) {
+            LOG_MESSAGE("unrecognized value for " + std::string(option) + " "
+                            + std::string(1, value[0]),
+                    Verbosity::ERROR);
+            return false;
+        }
+        if (converted_param < 0) {
+            LOG_MESSAGE("incorrect value for " + std::string(option) + " "
+                            + std::to_string(converted_param),
+                    Verbosity::ERROR);
+            return false;
+        }
+        *limit = converted_param;
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    bool parse(int argc, char *argv[])
+    {
+        int opt;
+        bool parse_ok = true;
+        static const struct option long_options[] = {
+            {"help",  no_argument,       NULL, 'h'},
+            {"rate",  required_argument, NULL, OPT_RATE},
+            {"burst", required_argument, NULL, OPT_BURST},
+            {"waitset", no_argument,     NULL, OPT_WAITSET},
+            {"ping",  no_argument,       NULL, OPT_PING},
+            {"echo",  no_argument,       NULL, OPT_ECHO},
+            {"perf-type", no_argument,   NULL, OPT_PERF_TYPE},
+            {"plain-type", no_argument,  NULL, OPT_PLAIN_TYPE},
+            {"payload-size", required_argument, NULL, OPT_PAYLOAD_SIZE},
+            {"num-instances", required_argument, NULL, OPT_NUM_INSTANCES},
+            {"handle-nil", no_argument,  NULL, OPT_HANDLE_NIL},
+            {"loan",  no_argument,       NULL, OPT_LOAN},
+            {"threads", required_argument, NULL, OPT_THREADS},
+            {"topic-per-thread", no_argument, NULL, OPT_TOPIC_PER_THREAD},
+            {"cpus",  required_argument, NULL, OPT_CPUS},
+            {"separate-participants", no_argument, NULL, OPT_SEPARATE_PARTICIPANTS},
+            {"output", required_argument, NULL, OPT_OUTPUT},
+            {"events", required_argument, NULL, OPT_EVENTS},
+            {"peer", required_argument, NULL, OPT_PEER},
+            {"announcement-period", required_argument, NULL, OPT_ANNOUNCEMENT_PERIOD},
+            {"no-multicast", no_argument, NULL, OPT_NO_MULTICAST},
+            {"tcp-port", required_argument, NULL, OPT_TCP_PORT},
+            {"server", no_argument, NULL, OPT_SERVER},
+            {"max-samples", required_argument, NULL, OPT_MAX_SAMPLES},
+            {"max-instances", required_argument, NULL, OPT_MAX_INSTANCES},
+            {"max-samples-per-instance", required_argument, NULL, OPT_MAX_SAMPLES_PER_INSTANCE},
+            {"preallocate", no_argument, NULL, OPT_PREALLOCATE},
+            {"take", required_argument, NULL, OPT_TAKE},
+            {"take-batch", required_argument, NULL, OPT_TAKE_BATCH},
+            {"batch", required_argument, NULL, OPT_BATCH},
+            {"batch-flush", required_argument, NULL, OPT_BATCH_FLUSH},
+            {"async", no_argument, NULL, OPT_ASYNC},
+            {"flow-rate", required_argument, NULL, OPT_FLOW_RATE},
+            {"flow-period", required_argument, NULL, OPT_FLOW_PERIOD},
+            {"flow-burst", required_argument, NULL, OPT_FLOW_BURST},
+            {NULL,    0,                 NULL, 0}
+        };
+        while ((opt = getopt_long(argc, argv, "hbrc:d:D:f:i:k:p:s:x:t:v:z:wPST:",
+                        long_options, NULL)) != -1)
+        {
+            switch (opt)
+            {
+            case 'v':
+                {
+                    if (optarg[0] != '\0')
+                    {
+                        switch (optarg[0])
+                        {
+                        case 'd':
+                            {
+                                logger.verbosity(DEBUG);
+                                break;
+                            }
+                        case 'e':
+                            {
+                                logger.verbosity(ERROR);
+                                break;
+                            }
+                        default:
+                            {
+                                LOG_MESSAGE("unrecognized value for verbosity "
+                                                + std::string(1, optarg[0]),
+                                        Verbosity::ERROR);
+                                parse_ok = false;
+                            }
+                        }
+                    }
+                    break;
+                }
+            case 'w':
+                {
+                    print_writer_samples = true;
+                    break;
+                }
+            case 'b':
+                {
+                    reliability_kind = BEST_EFFORT_RELIABILITY_QOS;
+                    break;
+                }
+            case 'c':
+                {
+                    color = strdup(optarg);
+                    break;
+                }
+            case 'd':
+                {
+                    int converted_param = sscanf(optarg, "%d", &domain_id);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for domain_id "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (domain_id < 0) {
+                        LOG_MESSAGE("incorrect value for domain_id "
+                                        + std::to_string(domain_id),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 'D':
+                {
+                if (optarg[0] != '\0')
+                {
+                    switch (optarg[0])
+                    {
+                    case 'v':
+                        {
+                            durability_kind = VOLATILE_DURABILITY_QOS;
+                            break;
+                        }
+                    case 'l':
+                        {
+                            durability_kind = TRANSIENT_LOCAL_DURABILITY_QOS;
+                            break;
+                        }
+                    case 't':
+                        {
+                            durability_kind = TRANSIENT_DURABILITY_QOS;
+                            break;
+                        }
+                    case 'p':
+                        {
+                            durability_kind = PERSISTENT_DURABILITY_QOS;
+                            break;
+                        }
+                    default:
+                        {
+                            LOG_MESSAGE("unrecognized value for durability "
+                                            + std::string(1, optarg[0]),
+                                    Verbosity::ERROR);
+                            parse_ok = false;
+                        }
+                    }
+                }
+                break;
+                }
+            case 'i':
+                {
+                    int converted_param = sscanf(optarg, "%d", &timebasedfilter_interval);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for timebasedfilter_interval "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (timebasedfilter_interval < 0) {
+                        LOG_MESSAGE("incorrect value for timebasedfilter_interval "
+                                        + std::to_string(timebasedfilter_interval),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 'f':
+                {
+                    int converted_param = sscanf(optarg, "%d", &deadline_interval);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for deadline_interval "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    } else if (deadline_interval < 0) {
+                        LOG_MESSAGE("incorrect value for deadline_interval "
+                                        + std::to_string(deadline_interval),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 'k':
+                {
+                    int converted_param = sscanf(optarg, "%d", &history_depth);
+                    if (converted_param == 0){
+                        LOG_MESSAGE("unrecognized value for history_depth "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    } else if (history_depth < 0) {
+                        LOG_MESSAGE("incorrect value for history_depth "
+                                        + std::to_string(history_depth),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 'p':
+                {
+                    partition = strdup(optarg);
+                    break;
+                }
+            case 'r':
+                {
+                    reliability_kind = RELIABLE_RELIABILITY_QOS;
+                    break;
+                }
+            case 's':
+                {
+                    int converted_param = sscanf(optarg, "%d", &ownership_strength);
+                    if (converted_param == 0){
+                        LOG_MESSAGE("unrecognized value for ownership_strength "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    } else if (ownership_strength < -1) {
+                        LOG_MESSAGE("incorrect value for ownership_strength "
+                                        + std::to_string(ownership_strength),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 't':
+                {
+                    topic_name = strdup(optarg);
+                    break;
+                }
+            case 'P':
+                {
+                    publish = true;
+                    break;
+                }
+            case 'S':
+                {
+                    subscribe = true;
+                    break;
+                }
+            case 'h':
+                {
+                    print_usage(argv[0]);
+                    exit(0);
+                    break;
+                }
+            case 'x':
+                {
+                    if (optarg[0] != '\0')
+                    {
+                        switch (optarg[0])
+                        {
+                        case '1':
+                            {
+                                data_representation = XCDR_DATA_REPRESENTATION;
+                                break;
+                            }
+                        case '2':
+                            {
+                                data_representation = XCDR2_DATA_REPRESENTATION;
+                                break;
+                            }
+                        default:
+                            {
+                            LOG_MESSAGE("unrecognized value for data representation "
+                                            + std::string(1, optarg[0]),
+                                    Verbosity::ERROR);
+                            parse_ok = false;
+                            }
+                        }
+                    }
+                    break;
+                }
+            case 'z':
+                {
+                    int converted_param = sscanf(optarg, "%d", &shapesize);
+                    if (converted_param == 0){
+                        LOG_MESSAGE("unrecognized value for shapesize "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (shapesize < 10 || shapesize > 99) {
+                        LOG_MESSAGE("incorrect value for shapesize "
+                                        + std::to_string(shapesize),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_RATE:
+                {
+                    int converted_param = sscanf(optarg, "%lf", &publish_rate);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for rate "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (!RatePacer::valid_rate(publish_rate)) {
+                        LOG_MESSAGE("incorrect value for rate " + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_BURST:
+                {
+                    int converted_param = sscanf(optarg, "%d", &publish_burst);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for burst "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (publish_burst < 1) {
+                        LOG_MESSAGE("incorrect value for burst "
+                                        + std::to_string(publish_burst),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_WAITSET:
+                {
+                    use_waitset = true;
+                    break;
+                }
+            case OPT_PING:
+                {
+                    latency_ping = true;
+                    break;
+                }
+            case OPT_ECHO:
+                {
+                    latency_echo = true;
+                    break;
+                }
+            case OPT_PERF_TYPE:
+                {
+                    perf_type = true;
+                    break;
+                }
+            case OPT_PLAIN_TYPE:
+                {
+                    plain_type = true;
+                    break;
+                }
+            case OPT_PAYLOAD_SIZE:
+                {
+                    int  multiplier = 1;
+                    char unit       = '\0';
+                    int converted_param = sscanf(optarg, "%d%c", &payload_size, &unit);
+                    if (unit == 'k' || unit == 'K') {
+                        multiplier = 1024;
+                    }
+                    else if (unit == 'm' || unit == 'M') {
+                        multiplier = 1024 * 1024;
+                    }
+                    if (converted_param <= 0
+                            || (converted_param == 2 && multiplier == 1)) {
+                        LOG_MESSAGE("unrecognized value for payload-size "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (payload_size < 0
+                            || payload_size > MAX_PAYLOAD_SIZE / multiplier) {
+                        LOG_MESSAGE("incorrect value for payload-size "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else {
+                        payload_size *= multiplier;
+                    }
+                    perf_type = true;
+                    break;
+                }
+            case OPT_NUM_INSTANCES:
+                {
+                    int converted_param = sscanf(optarg, "%d", &num_instances);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for num-instances "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (num_instances < 1) {
+                        LOG_MESSAGE("incorrect value for num-instances "
+                                        + std::to_string(num_instances),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_HANDLE_NIL:
+                {
+                    write_handle_nil = true;
+                    break;
+                }
+            case OPT_LOAN:
+                {
+                    use_loan = true;
+                    break;
+                }
+            case OPT_THREADS:
+                {
+                    int converted_param = sscanf(optarg, "%d", &num_threads);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for threads "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (num_threads < 1) {
+                        LOG_MESSAGE("incorrect value for threads "
+                                        + std::to_string(num_threads),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_TOPIC_PER_THREAD:
+                {
+                    topic_per_thread = true;
+                    break;
+                }
+            case OPT_CPUS:
+                {
+                    if ( !parse_cpu_list(optarg) ) {
+                        LOG_MESSAGE("incorrect value for cpus "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_SEPARATE_PARTICIPANTS:
+                {
+                    separate_participants = true;
+                    break;
+                }
+            case OPT_OUTPUT:
+                {
+                    if (strcmp(optarg, "print") == 0) {
+                        output_mode = OUTPUT_PRINT;
+                    }
+                    else if (strcmp(optarg, "async") == 0) {
+                        output_mode = OUTPUT_ASYNC;
+                    }
+                    else if (strcmp(optarg, "count") == 0) {
+                        output_mode = OUTPUT_COUNT;
+                    }
+                    else {
+                        LOG_MESSAGE("unrecognized value for output "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_EVENTS:
+                {
+                    if (events_destination != NULL) {
+                        free(events_destination);
+                    }
+                    events_destination = strdup(optarg);
+                    if ( !events.open(events_destination) ) {
+                        LOG_MESSAGE("incorrect value for events "
+                                        + std::string(optarg) + ": " + strerror(errno),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case 'T':
+                {
+                    if (strcmp(optarg, "shm") == 0 || strcmp(optarg, "udp") == 0
+                            || strcmp(optarg, "tcp") == 0) {
+                        if (transport != NULL) {
+                            free(transport);
+                        }
+                        transport = strdup(optarg);
+                    }
+                    else {
+                        LOG_MESSAGE("unrecognized value for transport "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_PEER:
+                {
+                    peers.push_back(optarg);
+                    break;
+                }
+            case OPT_ANNOUNCEMENT_PERIOD:
+                {
+                    int converted_param = 0;
+                    if (sscanf(optarg, "%d", &converted_param) == 0) {
+                        LOG_MESSAGE("unrecognized value for announcement-period "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (converted_param <= 0) {
+                        LOG_MESSAGE("incorrect value for announcement-period "
+                                        + std::to_string(converted_param),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else {
+                        announcement_period_ms = converted_param;
+                    }
+                    break;
+                }
+            case OPT_TCP_PORT:
+                {
+                    int converted_param = 0;
+                    if (sscanf(optarg, "%d", &converted_param) == 0) {
+                        LOG_MESSAGE("unrecognized value for tcp-port "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (converted_param <= 0 || converted_param > 65535) {
+                        LOG_MESSAGE("incorrect value for tcp-port "
+                                        + std::to_string(converted_param),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else {
+                        tcp_port = converted_param;
+                    }
+                    break;
+                }
+            case OPT_NO_MULTICAST:
+                {
+                    no_multicast = true;
+                    break;
+                }
+            case OPT_SERVER:
+                {
+                    server = true;
+                    break;
+                }
+            case OPT_MAX_SAMPLES:
+                {
+                    parse_ok = parse_resource_limit("max-samples", optarg, &max_samples) && parse_ok;
+                    break;
+                }
+            case OPT_MAX_INSTANCES:
+                {
+                    parse_ok = parse_resource_limit("max-instances", optarg, &max_instances) && parse_ok;
+                    break;
+                }
+            case OPT_MAX_SAMPLES_PER_INSTANCE:
+                {
+                    parse_ok = parse_resource_limit("max-samples-per-instance", optarg,
+                            &max_samples_per_instance) && parse_ok;
+                    break;
+                }
+            case OPT_PREALLOCATE:
+                {
+                    preallocate = true;
+                    break;
+                }
+            case OPT_TAKE:
+                {
+                    if (strcmp(optarg, "instance") == 0) {
+                        take_mode = TAKE_INSTANCE;
+                    }
+                    else if (strcmp(optarg, "all") == 0) {
+                        take_mode = TAKE_ALL;
+                    }
+                    else if (strcmp(optarg, "read") == 0) {
+                        take_mode = TAKE_READ;
+                    }
+                    else {
+                        LOG_MESSAGE("unrecognized value for take "
+                                        + std::string(optarg),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_TAKE_BATCH:
+                {
+                    int converted_param = sscanf(optarg, "%d", &take_batch);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for take-batch "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (take_batch < 0) {
+                        LOG_MESSAGE("incorrect value for take-batch "
+                                        + std::to_string(take_batch),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_BATCH:
+                {
+                    int converted_param = sscanf(optarg, "%d", &batch_samples);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for batch "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (batch_samples < 0) {
+                        LOG_MESSAGE("incorrect value for batch "
+                                        + std::to_string(batch_samples),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_BATCH_FLUSH:
+                {
+                    int converted_param = sscanf(optarg, "%d", &batch_flush_ms);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for batch-flush "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (batch_flush_ms < 1) {
+                        LOG_MESSAGE("incorrect value for batch-flush "
+                                        + std::to_string(batch_flush_ms),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_ASYNC:
+                {
+                    async_publish = true;
+                    break;
+                }
+            case OPT_FLOW_RATE:
+                {
+                    int converted_param = sscanf(optarg, "%d", &flow_rate_kbps);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for flow-rate "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (flow_rate_kbps < 0) {
+                        LOG_MESSAGE("incorrect value for flow-rate "
+                                        + std::to_string(flow_rate_kbps),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_FLOW_PERIOD:
                 {
-                    if (optarg[0] != '\0')
-                    {
-                        switch (optarg[0])
-                        {
-                        case '1':
-                            {
-                                data_representation = XCDR_DATA_REPRESENTATION;
-                                break;
-                            }
-                        case '2':
-                            {
-                                data_representation = XCDR2_DATA_REPRESENTATION;
-                                break;
-                            }
-                        default:
-                            {
-                            logger.log_message("unrecognized value for data representation "
-                                            + std::string(1, optarg[0]),
-                                    Verbosity::ERROR);
-                            parse_ok = false;
-                            }
-                        }
+                    int converted_param = sscanf(optarg, "%d", &flow_period_ms);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for flow-period "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (flow_period_ms < 1) {
+                        LOG_MESSAGE("incorrect value for flow-period "
+                                        + std::to_string(flow_period_ms),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    break;
+                }
+            case OPT_FLOW_BURST:
+                {
+                    int converted_param = sscanf(optarg, "%d", &flow_burst);
+                    if (converted_param == 0) {
+                        LOG_MESSAGE("unrecognized value for flow-burst "
+                                        + std::string(1, optarg[0]),
+                                Verbosity::ERROR);
+                        parse_ok = false;
+                    }
+                    else if (flow_burst < 1) {
+                        LOG_MESSAGE("incorrect value for flow-burst "
+                                        + std::to_string(flow_burst),
+                                Verbosity::ERROR);
+                        parse_ok = false;
                     }
                     break;
                 }
-            case 'z':
-                {
-                    int converted_param = sscanf(optarg, "%d", &shapesize);
-                    if (converted_param == 0){
-                        logger.log_message("unrecognized value for shapesize "
-                                        + std::string(1, optarg[0]),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    else if (shapesize < 10 || shapesize > 99) {
-                        logger.log_message("incorrect value for shapesize "
-                                        + std::to_string(shapesize),
-                                Verbosity::ERROR);
-                        parse_ok = false;
-                    }
-                    break;
+            case '?':
+                {
+                    parse_ok = false;
+                    break;
+                }
+            }
+
+        }
+
+        if ( parse_ok ) {
+            parse_ok = validate();
+        }
+        if ( !parse_ok ) {
+            print_usage(argv[0]);
+        } else {
+            std::string app_kind = server ? "server"
+                    : (publish && subscribe) ? "publisher and subscriber"
+                    : publish ? "publisher" : "subscriber";
+            LOG_MESSAGE("Shape Options: "
+                    "\n    This application is a " + app_kind +
+                    "\n    DomainId = " + std::to_string(domain_id) +
+                    "\n    ReliabilityKind = " + QosUtils::to_string(reliability_kind) +
+                    "\n    DurabilityKind = " + QosUtils::to_string(durability_kind) +
+                    "\n    DataRepresentation = " + QosUtils::to_string(data_representation) +
+                    "\n    HistoryDepth = " + std::to_string(history_depth) +
+                    "\n    OwnershipStrength = " + std::to_string(ownership_strength) +
+                    "\n    TimeBasedFilterInterval = " + std::to_string(timebasedfilter_interval) +
+                    "\n    DeadlineInterval = " + std::to_string(deadline_interval) +
+                    "\n    Shapesize = " + std::to_string(shapesize) +
+                    "\n    PublishRate = " + std::to_string(publish_rate) +
+                    "\n    PublishBurst = " + std::to_string(publish_burst) +
+                    "\n    UseWaitSet = " + std::to_string(use_waitset) +
+                    "\n    LatencyPing = " + std::to_string(latency_ping) +
+                    "\n    LatencyEcho = " + std::to_string(latency_echo) +
+                    "\n    PerfType = " + std::to_string(perf_type) +
+                    "\n    PlainType = " + std::to_string(plain_type) +
+                    "\n    PayloadSize = " + std::to_string(payload_size) +
+                    "\n    NumInstances = " + std::to_string(num_instances) +
+                    "\n    WriteHandleNil = " + std::to_string(write_handle_nil) +
+                    "\n    UseLoan = " + std::to_string(use_loan) +
+                    "\n    Threads = " + std::to_string(num_threads) +
+                    "\n    TopicPerThread = " + std::to_string(topic_per_thread) +
+                    "\n    Cpus = " + cpu_list_string() +
+                    "\n    SeparateParticipants = " + std::to_string(separate_participants) +
+                    "\n    Output = " + std::string(output_mode == OUTPUT_ASYNC ? "async"
+                            : output_mode == OUTPUT_COUNT ? "count" : "print") +
+                    "\n    Events = " + std::string(events_destination ? events_destination : "(none)") +
+                    "\n    Peers = " + std::to_string(peers.size()) +
+                    "\n    AnnouncementPeriod = " + std::to_string(announcement_period_ms) +
+                    "\n    NoMulticast = " + std::to_string(no_multicast) +
+                    "\n    Transport = " + std::string(transport ? transport : "(default)") +
+                    "\n    TcpPort = " + std::to_string(tcp_port) +
+                    "\n    Server = " + std::to_string(server) +
+                    "\n    MaxSamples = " + std::to_string(max_samples) +
+                    "\n    MaxInstances = " + std::to_string(max_instances) +
+                    "\n    MaxSamplesPerInstance = " + std::to_string(max_samples_per_instance) +
+                    "\n    Preallocate = " + std::to_string(preallocate) +
+                    "\n    Take = " + std::string(take_mode == TAKE_ALL ? "all"
+                            : take_mode == TAKE_READ ? "read" : "instance") +
+                    "\n    TakeBatch = " + std::to_string(take_batch) +
+                    "\n    BatchSamples = " + std::to_string(batch_samples) +
+                    "\n    BatchFlush = " + std::to_string(batch_flush_ms) +
+                    "\n    AsyncPublish = " + std::to_string(async_publish) +
+                    "\n    FlowRate = " + std::to_string(flow_rate_kbps) +
+                    "\n    FlowPeriod = " + std::to_string(flow_period_ms) +
+                    "\n    FlowBurst = " + std::to_string(flow_burst) +
+                    "\n    Verbosity = " + QosUtils::to_string(logger.verbosity()),
+                    Verbosity::DEBUG);
+            if (topic_name != NULL){
+                LOG_MESSAGE("    Topic = " + std::string(topic_name),
+                        Verbosity::DEBUG);
+            }
+            if (color != NULL) {
+                LOG_MESSAGE("    Color = " + std::string(color),
+                        Verbosity::DEBUG);
+            }
+            if (partition != NULL) {
+                LOG_MESSAGE("    Partition = " + std::string(partition), Verbosity::DEBUG);
+            }
+        }
+        return parse_ok;
+    }
+};
+
+/*************************************************************/
+class DPListener : public DomainParticipantListener
+{
+public:
+    void on_inconsistent_topic         (Topic *topic,  const InconsistentTopicStatus &) {
+        const char *topic_name = topic->get_name() NAME_ACCESSOR;
+        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s'\n", __FUNCTION__, topic_name, type_name);
+        events.emit("inconsistent_topic", topic_name);
+    }
+
+    void on_offered_incompatible_qos(DataWriter *dw,  const OfferedIncompatibleQosStatus & status) {
+        Topic      *topic       = dw->get_topic( );
+        const char *topic_name  = topic->get_name() NAME_ACCESSOR;
+        const char *type_name   = topic->get_type_name() NAME_ACCESSOR;
+        const char *policy_name = NULL;
+        policy_name = get_qos_policy_name(status.last_policy_id);
+        printf("%s() topic: '%s'  type: '%s' : %d (%s)\n", __FUNCTION__,
+                topic_name, type_name,
+                status.last_policy_id,
+                policy_name );
+        events.emit("offered_incompatible_qos", topic_name,
+                "\"policy_id\":%d,\"policy\":\"%s\"", status.last_policy_id, policy_name);
+    }
+
+    void on_publication_matched (DataWriter *dw, const PublicationMatchedStatus & status) {
+        Topic      *topic      = dw->get_topic( );
+        const char *topic_name = topic->get_name() NAME_ACCESSOR;
+        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : matched readers %d (change = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.current_count, status.current_count_change);
+        if (status.current_count_change > 0) {
+            startup_times.record(StartupTimes::FIRST_MATCH);
+        }
+        events.emit("publication_matched", topic_name,
+                "\"current_count\":%d,\"current_count_change\":%d",
+                status.current_count, status.current_count_change);
+    }
+
+    void on_offered_deadline_missed (DataWriter *dw, const OfferedDeadlineMissedStatus & status) {
+        Topic      *topic      = dw->get_topic( );
+        const char *topic_name = topic->get_name() NAME_ACCESSOR;
+        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.total_count, status.total_count_change);
+        events.emit("offered_deadline_missed", topic_name,
+                "\"total_count\":%d,\"total_count_change\":%d",
+                status.total_count, status.total_count_change);
+    }
+
+    void on_liveliness_lost (DataWriter *dw, const LivelinessLostStatus & status) {
+        Topic      *topic      = dw->get_topic( );
+        const char *topic_name = topic->get_name() NAME_ACCESSOR;
+        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.total_count, status.total_count_change);
+        events.emit("liveliness_lost", topic_name,
+                "\"total_count\":%d,\"total_count_change\":%d",
+                status.total_count, status.total_count_change);
+    }
+
+    void on_requested_incompatible_qos (DataReader *dr, const RequestedIncompatibleQosStatus & status) {
+        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
+        const char       *topic_name = td->get_name() NAME_ACCESSOR;
+        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
+        const char *policy_name = NULL;
+        policy_name = get_qos_policy_name(status.last_policy_id);
+        printf("%s() topic: '%s'  type: '%s' : %d (%s)\n", __FUNCTION__,
+                topic_name, type_name, status.last_policy_id,
+                policy_name);
+        events.emit("requested_incompatible_qos", topic_name,
+                "\"policy_id\":%d,\"policy\":\"%s\"", status.last_policy_id, policy_name);
+    }
+
+    void on_subscription_matched (DataReader *dr, const SubscriptionMatchedStatus & status) {
+        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
+        const char       *topic_name = td->get_name() NAME_ACCESSOR;
+        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : matched writers %d (change = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.current_count, status.current_count_change);
+        if (status.current_count_change > 0) {
+            startup_times.record(StartupTimes::FIRST_MATCH);
+        }
+        events.emit("subscription_matched", topic_name,
+                "\"current_count\":%d,\"current_count_change\":%d",
+                status.current_count, status.current_count_change);
+    }
+
+    void on_requested_deadline_missed (DataReader *dr, const RequestedDeadlineMissedStatus & status) {
+        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
+        const char       *topic_name = td->get_name() NAME_ACCESSOR;
+        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.total_count, status.total_count_change);
+        events.emit("requested_deadline_missed", topic_name,
+                "\"total_count\":%d,\"total_count_change\":%d",
+                status.total_count, status.total_count_change);
+    }
+
+    void on_liveliness_changed (DataReader *dr, const LivelinessChangedStatus & status) {
+        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
+        const char       *topic_name = td->get_name() NAME_ACCESSOR;
+        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : (alive = %d, not_alive = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.alive_count, status.not_alive_count);
+        if (status.alive_count > 0) {
+            startup_times.record(StartupTimes::FIRST_ALIVE);
+        }
+        events.emit("liveliness_changed", topic_name,
+                "\"alive_count\":%d,\"not_alive_count\":%d",
+                status.alive_count, status.not_alive_count);
+    }
+
+    void on_sample_rejected (DataReader *dr, const SampleRejectedStatus & status) {
+        // only the first time: at the resource limits there can be one per
+        // sample, the reader reports how many at the end
+        if (status.total_count != status.total_count_change) {
+            return;
+        }
+        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
+        const char       *topic_name = td->get_name() NAME_ACCESSOR;
+        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
+        printf("%s() topic: '%s'  type: '%s' : (total = %d, reason = %d)\n", __FUNCTION__,
+                topic_name, type_name, status.total_count, (int)status.last_reason);
+        events.emit("sample_rejected", topic_name,
+                "\"total_count\":%d,\"reason\":%d",
+                status.total_count, (int)status.last_reason);
+    }
+
+  void on_data_available (DataReader *) {}
+  void on_sample_lost (DataReader *, const SampleLostStatus &) {}
+  void on_data_on_readers (Subscriber *) {}
+};
+
+/*************************************************************/
+/* Blocks the calling thread on a WaitSet with a ReadCondition attached
+ * (any sample, view and instance state), so the subscriber wakes up as
+ * soon as the middleware has data instead of polling the DataReader.
+ */
+class DataReaderWaiter {
+public:
+    DataReaderWaiter()
+    {
+        reader = NULL;
+        read_condition = NULL;
+#if !defined(OPENDDS)
+        waitset = NULL;
+#endif
+    }
+
+    ~DataReaderWaiter()
+    {
+        detach();
+    }
+
+    //-------------------------------------------------------------
+    bool attach(DataReader *dr)
+    {
+        read_condition = dr->create_readcondition(ANY_SAMPLE_STATE, ANY_VIEW_STATE, ANY_INSTANCE_STATE);
+        if (read_condition == NULL) {
+            LOG_MESSAGE("failed to create read condition", Verbosity::ERROR);
+            return false;
+        }
+        reader = dr;
+        waitset = new WaitSet();
+#if   defined(EPROSIMA_FAST_DDS)
+        ReturnCode_t retval = waitset->attach_condition(*read_condition);
+#else
+        ReturnCode_t retval = waitset->attach_condition(read_condition);
+#endif
+        if (retval != RETCODE_OK) {
+            LOG_MESSAGE("failed to attach read condition to waitset", Verbosity::ERROR);
+            return false;
+        }
+        LOG_MESSAGE("WaitSet created", Verbosity::DEBUG);
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    void detach()
+    {
+        if (read_condition != NULL) {
+#if   defined(EPROSIMA_FAST_DDS)
+            waitset->detach_condition(*read_condition);
+#else
+            waitset->detach_condition(read_condition);
+#endif
+            reader->delete_readcondition(read_condition);
+            read_condition = NULL;
+        }
+#if !defined(OPENDDS)
+        delete waitset;
+        waitset = NULL;
+#endif
+    }
+
+    //-------------------------------------------------------------
+    // Returns true when the read condition triggered, false on timeout.
+    bool wait(int timeout_ms)
+    {
+        Duration_t   timeout;
+        timeout.SECONDS_FIELD_NAME = timeout_ms / 1000;
+        timeout.nanosec            = (timeout_ms % 1000) * 1000000;
+#if   defined(TWINOAKS_COREDX)
+        ReturnCode_t retval = waitset->wait(&active_conditions, &timeout);
+#else
+        ReturnCode_t retval = waitset->wait(active_conditions, timeout);
+#endif
+        return retval == RETCODE_OK;
+    }
+
+private:
+    DataReader    *reader;
+    ReadCondition *read_condition;
+    ConditionSeq   active_conditions;   /* reused by every wait */
+#if   defined(OPENDDS)
+    WaitSet_var    waitset;
+#else
+    WaitSet       *waitset;
+#endif
+};
+
+
+/*************************************************************/
+// The participant of options->domain_id, with the discovery and transport
+// options of the command line. With -T tcp the participant of the writers
+// ('tcp_server') accepts the connections and the others connect to it.
+DomainParticipant *create_participant(ShapeOptions *options, DomainParticipantListener *listener,
+        bool tcp_server)
+{
+#ifndef OBTAIN_DOMAIN_PARTICIPANT_FACTORY
+#define OBTAIN_DOMAIN_PARTICIPANT_FACTORY DomainParticipantFactory::get_instance()
+#endif
+    DomainParticipantFactory *dpf = OBTAIN_DOMAIN_PARTICIPANT_FACTORY;
+    if (dpf == NULL) {
+        LOG_MESSAGE("failed to create participant factory (missing license?).", Verbosity::ERROR);
+        return NULL;
+    }
+    LOG_MESSAGE("Participant Factory created", Verbosity::DEBUG);
+#ifdef CONFIGURE_PARTICIPANT_FACTORY
+    static bool factory_configured = false;
+    if ( !factory_configured ) {
+        CONFIGURE_PARTICIPANT_FACTORY
+        factory_configured = true;
+    }
+#endif
+    startup_times.record(StartupTimes::PARTICIPANT_FACTORY);
+
+    // vendors that set the discovery up per domain (CONFIGURE_DOMAIN_DISCOVERY)
+    // cannot give two participants of a domain different discovery options
+    if ( !CONFIGURE_DOMAIN_DISCOVERY(options->domain_id, options->peers,
+                options->announcement_period_ms, options->no_multicast) ) {
+        LOG_MESSAGE("failed to create participant: domain " + std::to_string(options->domain_id)
+                        + " already has a participant with other --peer/--announcement-period/"
+                        "--no-multicast options",
+                Verbosity::ERROR);
+        return NULL;
+    }
+
+    DomainParticipant *dp;
+    bool discovery_options = !options->peers.empty() || options->announcement_period_ms > 0;
+    if ( !discovery_options && options->transport == NULL && options->flow_rate_kbps == 0 ) {
+        dp = dpf->create_participant( options->domain_id, PARTICIPANT_QOS_DEFAULT, listener, LISTENER_STATUS_MASK_ALL );
+    }
+    else {
+        DomainParticipantQos dp_qos;
+        dpf->get_default_participant_qos(dp_qos);
+        if ( discovery_options
+                && !CONFIGURE_PARTICIPANT_DISCOVERY(dp_qos, options->peers,
+                    options->announcement_period_ms, options->no_multicast,
+                    options->transport) ) {
+            LOG_MESSAGE("warning: failed to configure --peer/--announcement-period/"
+                            "--no-multicast, using the default discovery",
+                    Verbosity::ERROR);
+        }
+        // after the discovery: the TCP clients connect to the initial peers
+        if ( options->transport != NULL
+                && !CONFIGURE_PARTICIPANT_TRANSPORT(dp_qos, std::string(options->transport),
+                    options->domain_id, options->tcp_port, tcp_server) ) {
+            LOG_MESSAGE("warning: transport " + std::string(options->transport)
+                            + " is not supported, using the default transports",
+                    Verbosity::ERROR);
+        }
+        if ( options->flow_rate_kbps > 0
+                && !CONFIGURE_PARTICIPANT_FLOW_CONTROLLER(dp_qos,
+                    (int)std::min<int64_t>((int64_t)options->flow_rate_kbps * 1024
+                            * options->flow_period_ms / 1000, INT32_MAX),
+                    options->flow_period_ms, options->flow_burst) ) {
+            LOG_MESSAGE("warning: flow controllers are not supported by this vendor",
+                    Verbosity::ERROR);
+        }
+        dp = dpf->create_participant( options->domain_id, dp_qos, listener, LISTENER_STATUS_MASK_ALL );
+    }
+    if (dp == NULL) {
+        LOG_MESSAGE("failed to create participant (missing license?).", Verbosity::ERROR);
+        return NULL;
+    }
+    if ( !BIND_PARTICIPANT_TRANSPORT(dp, options->transport, options->no_multicast,
+                options->tcp_port, tcp_server) ) {
+        LOG_MESSAGE("warning: failed to bind the transport of the participant, "
+                        "using the default transports",
+                Verbosity::ERROR);
+    }
+    LOG_MESSAGE("Participant created", Verbosity::DEBUG);
+    startup_times.record(StartupTimes::PARTICIPANT);
+    memory_footprint.record(MemoryFootprint::PARTICIPANT);
+    return dp;
+}
+
+/*************************************************************/
+/* A participant that the sessions of --server share: they find the topics
+ * that an earlier session created instead of creating them, and give
+ * their content filtered topics names of their own. The last session that
+ * uses a topic deletes it, so later sessions may use the name with another
+ * data type.
+ */
+struct SharedParticipant {
+    SharedParticipant()
+    {
+        dp = NULL;
+        filters_created = 0;
+    }
+
+    DomainParticipant     *dp;
+    DPListener             listener;
+    std::set<std::string>  registered_types;
+    std::map<std::string, int> topic_sessions;   /* sessions using each topic */
+    int                    filters_created;
+};
+
+/*************************************************************/
+/* What --server needs from a ShapeApplication, whatever its data type */
+class ShapeSession {
+public:
+    virtual ~ShapeSession() { }
+
+    virtual bool run(ShapeOptions *options) = 0;
+    virtual void print_reports(ShapeOptions *options) = 0;
+
+    // From another thread: makes run() return
+    virtual void stop() = 0;
+    // From another thread: the writers and readers print their reports;
+    // false for --ping and --echo
+    virtual bool request_reports() = 0;
+    virtual bool reports_pending() = 0;
+    // From another thread: false when there is no writer to pace
+    virtual bool set_rate(double rate) = 0;
+};
+
+/*************************************************************/
+/* The application is instantiated for the data type selected on the
+ * command line (ShapeType, ShapePerfType or ShapePlainType). TypeTraits
+ * provides the vendor-specific type, sequence, DataReader and DataWriter
+ * names, see DECLARE_TYPE_TRAITS.
+ */
+template <typename TypeTraits>
+class ShapeApplication : public ShapeSession {
+
+private:
+    typedef typename TypeTraits::Type        Sample;
+    typedef typename TypeTraits::Seq         SampleSeq;
+    typedef typename TypeTraits::DataReader  SampleDataReader;
+    typedef typename TypeTraits::DataWriter  SampleDataWriter;
+
+    /* A DataWriter or a DataReader, with the statistics of the thread
+     * that drives it */
+    struct Endpoint {
+        Endpoint(ShapeOptions *options, int endpoint_index, int thread_index)
+            : pacer(options->publish_rate, options->publish_burst)
+        {
+            index    = endpoint_index;
+            cpu      = options->cpus.empty()
+                    ? -1 : options->cpus[thread_index % options->cpus.size()];
+            result   = true;
+            dw       = NULL;
+            dr       = NULL;
+            waiter   = NULL;
+            output   = NULL;
+            use_loan = options->use_loan;
+            take_mode = options->take_mode;
+            take_max_samples = options->take_batch > 0
+                    ? options->take_batch : LENGTH_UNLIMITED;
+            take_calls = 0;
+            taken_samples = 0;
+            take_cpu_ns = 0;
+            max_calls_per_pass = 0;
+            write_failures = 0;
+            report_requested = false;
+            created_kb = 0;
+            run_kb   = 0;
+        }
+
+        ~Endpoint()
+        {
+            delete waiter;
+            if (output != NULL) {
+                output_flusher.destroy_output(output);
+            }
+        }
+
+        int                 index;
+        std::string         topic_name;
+        int                 cpu;        /* -1: not pinned */
+        bool                result;
+
+        SampleDataWriter   *dw;
+        SampleDataReader   *dr;
+        DataReaderWaiter   *waiter;
+        SampleOutput       *output;     /* created and destroyed by output_flusher */
+
+        ThroughputMeter     throughput;
+        AllocationMeter     allocations;
+        std::atomic<bool>   report_requested;   /* --server "stats" */
+        int64_t             created_kb; /* resident growth while it was created */
+        int64_t             run_kb;     /* and while its thread ran (with the others') */
+
+        /* writer */
+        RatePacer           pacer;
+        LatencyHistogram    write_cost;
+        bool                use_loan;
+        uint64_t            write_failures;
+
+        /* reader */
+        SampleSeq           samples;        /* reused by every take */
+        SampleInfoSeq       sample_infos;
+        TakeMode            take_mode;
+        int                 take_max_samples;   /* --take-batch or LENGTH_UNLIMITED */
+        LatencyHistogram    take_cost;
+        LatencyHistogram    release_cost;   /* TAKE_READ: take() of the read samples */
+        uint64_t            take_calls;
+        uint64_t            taken_samples;
+        uint64_t            take_cpu_ns;    /* thread cpu of the passes that got samples */
+        uint64_t            max_calls_per_pass;
+        SampleAccounting    accounting;      /* perf types only */
+        LatencyHistogram    one_way_latency; /* perf types only */
+    };
+
+    DPListener               dp_listener;
+
+    DomainParticipantFactory *dpf;
+    DomainParticipant        *dp;
+    Publisher                *pub;
+    Subscriber               *sub;
+    std::vector<Topic *>     topics;
+    std::vector<Endpoint *>  endpoints;
+    std::string              publish_mode;  /* of the writers, see configure_publish_mode */
+
+    /* --server session */
+    SharedParticipant        *shared;
+    std::string               filter_suffix;
+    std::vector<ContentFilteredTopic *> filtered_topics;
+    std::atomic<bool>         stopped;
+    std::mutex                report_mutex;
+
+    /* latency (ping/echo) mode */
+    Topic                    *echo_topic;
+    SampleDataReader         *echo_dr;
+    SampleDataWriter         *echo_dw;
+    DataReaderWaiter         *echo_waiter;
+
+    char                     *color;
+
+    int                        da_width;
+    int                        da_height;
+
+public:
+    //-------------------------------------------------------------
+    ShapeApplication()
+    {
+        dpf = NULL;
+        dp  = NULL;
+
+        pub = NULL;
+        sub = NULL;
+        color = NULL;
+
+        shared  = NULL;
+        stopped = false;
+
+        echo_topic  = NULL;
+        echo_dr     = NULL;
+        echo_dw     = NULL;
+        echo_waiter = NULL;
+    }
+
+    //-------------------------------------------------------------
+    ~ShapeApplication()
+    {
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            delete endpoints[i];
+        }
+        delete echo_waiter;
+        if ( shared != NULL ) {
+            // the participant and its topics outlive the session
+            if (pub) {
+                pub->delete_contained_entities( );
+                dp->delete_publisher( pub );
+            }
+            if (sub) {
+                sub->delete_contained_entities( );
+                dp->delete_subscriber( sub );
+            }
+            for (size_t i = 0; i < filtered_topics.size(); i++) {
+                dp->delete_contentfilteredtopic( filtered_topics[i] );
+            }
+            for (size_t i = 0; i < topics.size(); i++) {
+                release_topic(topics[i]);
+            }
+            if (echo_topic) release_topic(echo_topic);
+        }
+        else {
+            if (dp)  dp->delete_contained_entities( );
+            if (dpf) dpf->delete_participant( dp );
+        }
+
+        if (color) free(color);
+    }
+
+    //-------------------------------------------------------------
+    // With -P and -S both writers and readers are created, unless they go
+    // to separate participants (see run_application). The sessions of
+    // --server create theirs on a participant they share.
+    bool initialize(ShapeOptions *options, bool create_writers, bool create_readers,
+            SharedParticipant *participant = NULL)
+    {
+        if ( participant != NULL ) {
+            shared = participant;
+            dp     = participant->dp;
+            filter_suffix = "_" + std::to_string(++participant->filters_created);
+        }
+        else {
+            dp = create_participant(options, &dp_listener, create_writers);
+            if (dp == NULL) {
+                return false;
+            }
+        }
+        if ( shared == NULL || shared->registered_types.count(TypeTraits::type_name()) == 0 ) {
+            if (TypeTraits::register_type(dp) != RETCODE_OK) {
+                LOG_MESSAGE("failed to register type", Verbosity::ERROR);
+                return false;
+            }
+            if ( shared != NULL ) {
+                shared->registered_types.insert(TypeTraits::type_name());
+            }
+        }
+        startup_times.record(StartupTimes::REGISTER_TYPE);
+
+        int num_topics = options->topic_per_thread ? options->num_threads : 1;
+        for (int i = 0; i < num_topics; i++) {
+            std::string topic_name = get_topic_name(options, i);
+            printf("Create topic: %s\n", topic_name.c_str() );
+            Topic *topic = find_or_create_topic(topic_name);
+            if (topic == NULL) {
+                LOG_MESSAGE("failed to create topic", Verbosity::ERROR);
+                return false;
+            }
+            events.emit("topic_created", topic_name.c_str());
+            topics.push_back(topic);
+        }
+        startup_times.record(StartupTimes::TOPICS);
+
+        if ( create_writers ) {
+            if ( !init_publisher(options) ) {
+                return false;
+            }
+            if ( options->latency_ping && !init_echo_reader(options) ) {
+                return false;
+            }
+        }
+        if ( create_readers ) {
+            if ( !init_subscriber(options) ) {
+                return false;
+            }
+            if ( options->latency_echo && !init_echo_writer(options) ) {
+                return false;
+            }
+        }
+        startup_times.record(StartupTimes::ENDPOINTS);
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    // SIGINT ends every session, stop() only this one
+    bool done()
+    {
+        return all_done || stopped;
+    }
+
+    //-------------------------------------------------------------
+    bool run(ShapeOptions *options)
+    {
+        if ( options->latency_ping ) {
+            return run_ping(options);
+        }
+        else if ( options->latency_echo ) {
+            return run_echo();
+        }
+        else if ( !endpoints.empty() ) {
+            return run_endpoints(options);
+        }
+
+        return false;
+    }
+
+    //-------------------------------------------------------------
+    void stop()
+    {
+        stopped = true;
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            endpoints[i]->pacer.wake();
+        }
+    }
+
+    //-------------------------------------------------------------
+    bool request_reports()
+    {
+        if ( echo_topic != NULL || endpoints.empty() ) {
+            return false;
+        }
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            endpoints[i]->report_requested = true;
+            endpoints[i]->pacer.wake();
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    bool reports_pending()
+    {
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            if ( endpoints[i]->report_requested ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //-------------------------------------------------------------
+    bool set_rate(double rate)
+    {
+        bool writers = false;
+        if ( echo_topic != NULL ) {
+            return false;
+        }
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            if ( endpoints[i]->dw != NULL ) {
+                endpoints[i]->pacer.set_rate(rate);
+                writers = true;
+            }
+        }
+        return writers;
+    }
+
+    //-------------------------------------------------------------
+    // Topic 0 uses the name as given, the others (--topic-per-thread) get
+    // an index appended
+    static std::string get_topic_name(ShapeOptions *options, int index)
+    {
+        std::string topic_name(options->topic_name);
+        if (index > 0) {
+            topic_name += "_" + std::to_string(index);
+        }
+        return topic_name;
+    }
+
+    //-------------------------------------------------------------
+    // On a shared participant an earlier session may have created the topic
+    Topic *find_or_create_topic(const std::string &topic_name)
+    {
+        if ( shared == NULL ) {
+            return dp->create_topic( topic_name.c_str(), TypeTraits::type_name(), TOPIC_QOS_DEFAULT, NULL, LISTENER_STATUS_MASK_NONE);
+        }
+        Topic *topic = dynamic_cast<Topic *>(dp->lookup_topicdescription(topic_name.c_str()));
+        if ( topic != NULL ) {
+            if ( strcmp(topic->get_type_name() NAME_ACCESSOR, TypeTraits::type_name()) != 0 ) {
+                LOG_MESSAGE("topic " + topic_name + " already exists with type "
+                                + std::string(topic->get_type_name() NAME_ACCESSOR),
+                        Verbosity::ERROR);
+                return NULL;
+            }
+        }
+        else {
+            topic = dp->create_topic( topic_name.c_str(), TypeTraits::type_name(), TOPIC_QOS_DEFAULT, NULL, LISTENER_STATUS_MASK_NONE);
+            if ( topic == NULL ) {
+                return NULL;
+            }
+        }
+        shared->topic_sessions[topic_name]++;
+        return topic;
+    }
+
+    //-------------------------------------------------------------
+    // The session does not use the topic of the shared participant anymore
+    void release_topic(Topic *topic)
+    {
+        std::string topic_name(topic->get_name() NAME_ACCESSOR);
+        if ( --shared->topic_sessions[topic_name] == 0 ) {
+            shared->topic_sessions.erase(topic_name);
+            dp->delete_topic( topic );
+        }
+    }
+
+    //-------------------------------------------------------------
+    bool create_publisher(ShapeOptions *options)
+    {
+        PublisherQos  pub_qos;
+
+        dp->get_default_publisher_qos( pub_qos );
+        if ( options->partition != NULL ) {
+            ADD_PARTITION(pub_qos.partition, options->partition);
+        }
+
+        pub = dp->create_publisher(pub_qos, NULL, LISTENER_STATUS_MASK_NONE);
+        if (pub == NULL) {
+            LOG_MESSAGE("failed to create publisher", Verbosity::ERROR);
+            return false;
+        }
+        LOG_MESSAGE("Publisher created", Verbosity::DEBUG);
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    void configure_datawriter_qos(ShapeOptions *options, DataWriterQos &dw_qos)
+    {
+        LOG_MESSAGE("Data Writer QoS:", Verbosity::DEBUG);
+        pub->get_default_datawriter_qos( dw_qos );
+        dw_qos.reliability FIELD_ACCESSOR.kind = options->reliability_kind;
+        LOG_MESSAGE("    Reliability = " + QosUtils::to_string(dw_qos.reliability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        dw_qos.durability FIELD_ACCESSOR.kind  = options->durability_kind;
+        LOG_MESSAGE("    Durability = " + QosUtils::to_string(dw_qos.durability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+
+#if   defined(RTI_CONNEXT_DDS)
+        DataRepresentationIdSeq data_representation_seq;
+        data_representation_seq.ensure_length(1,1);
+        data_representation_seq[0] = options->data_representation;
+        dw_qos.representation.value = data_representation_seq;
+
+#elif  defined(TWINOAKS_COREDX)
+        dw_qos.representation.value.clear( );
+        dw_qos.representation.value.push_back( options->data_representation );
+        
+#elif   defined(OPENDDS)
+        dw_qos.representation.value.length(1);
+        dw_qos.representation.value[0] = options->data_representation;
+#endif
+#if !defined(EPROSIMA_FAST_DDS)
+        LOG_MESSAGE("    Data_Representation = " + QosUtils::to_string(dw_qos.representation  FIELD_ACCESSOR.value[0]), Verbosity::DEBUG);
+#endif
+        if ( options->ownership_strength != -1 ) {
+            dw_qos.ownership FIELD_ACCESSOR.kind = EXCLUSIVE_OWNERSHIP_QOS;
+            dw_qos.ownership_strength FIELD_ACCESSOR.value = options->ownership_strength;
+        }
+
+        if ( options->ownership_strength == -1 ) {
+            dw_qos.ownership  FIELD_ACCESSOR.kind = SHARED_OWNERSHIP_QOS;
+        }
+        LOG_MESSAGE("    Ownership = " + QosUtils::to_string(dw_qos.ownership FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        if (dw_qos.ownership FIELD_ACCESSOR.kind == EXCLUSIVE_OWNERSHIP_QOS){
+            LOG_MESSAGE("    OwnershipStrength = " + std::to_string(dw_qos.ownership_strength FIELD_ACCESSOR.value), Verbosity::DEBUG);
+        }
+
+        if ( options->deadline_interval > 0 ) {
+            dw_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME = options->deadline_interval;
+            dw_qos.deadline FIELD_ACCESSOR.period.nanosec  = 0;
+        }
+        LOG_MESSAGE("    DeadlinePeriod = " + std::to_string(dw_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME), Verbosity::DEBUG);
+
+        // options->history_depth < 0 means leave default value
+        if ( options->history_depth > 0 )  {
+            dw_qos.history FIELD_ACCESSOR.kind  = KEEP_LAST_HISTORY_QOS;
+            dw_qos.history FIELD_ACCESSOR.depth = options->history_depth;
+        }
+        else if ( options->history_depth == 0 ) {
+            dw_qos.history FIELD_ACCESSOR.kind  = KEEP_ALL_HISTORY_QOS;
+        }
+        LOG_MESSAGE("    History = " + QosUtils::to_string(dw_qos.history FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        if (dw_qos.history FIELD_ACCESSOR.kind == KEEP_LAST_HISTORY_QOS){
+            LOG_MESSAGE("    HistoryDepth = " + std::to_string(dw_qos.history FIELD_ACCESSOR.depth), Verbosity::DEBUG);
+        }
+
+        configure_resource_limits(options, dw_qos);
+        configure_publish_mode(options, dw_qos);
+
+        // ShapePlainType is fixed-size and can be shared with (and loaned
+        // to) local endpoints; ShapePerfType has an unbounded payload
+        if ( options->plain_type ) {
+            CONFIGURE_DATA_SHARING(dw_qos);
+        }
+        else if ( options->perf_type ) {
+            CONFIGURE_UNBOUNDED_DATAWRITER_QOS(dw_qos);
+        }
+    }
+
+    //-------------------------------------------------------------
+    bool create_subscriber(ShapeOptions *options)
+    {
+        SubscriberQos sub_qos;
+
+        dp->get_default_subscriber_qos( sub_qos );
+        if ( options->partition != NULL ) {
+            ADD_PARTITION(sub_qos.partition, options->partition);
+        }
+
+        sub = dp->create_subscriber( sub_qos, NULL, LISTENER_STATUS_MASK_NONE );
+        if (sub == NULL) {
+            LOG_MESSAGE("failed to create subscriber", Verbosity::ERROR);
+            return false;
+        }
+        LOG_MESSAGE("Subscriber created", Verbosity::DEBUG);
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    void configure_datareader_qos(ShapeOptions *options, DataReaderQos &dr_qos)
+    {
+        LOG_MESSAGE("Data Reader QoS:", Verbosity::DEBUG);
+        sub->get_default_datareader_qos( dr_qos );
+        dr_qos.reliability FIELD_ACCESSOR.kind = options->reliability_kind;
+        LOG_MESSAGE("    Reliability = " + QosUtils::to_string(dr_qos.reliability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        dr_qos.durability FIELD_ACCESSOR.kind  = options->durability_kind;
+        LOG_MESSAGE("    Durability = " + QosUtils::to_string(dr_qos.durability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+
+#if   defined(RTI_CONNEXT_DDS)
+        DataRepresentationIdSeq data_representation_seq;
+        data_representation_seq.ensure_length(1,1);
+        data_representation_seq[0] = options->data_representation;
+        dr_qos.representation.value = data_representation_seq;
+#elif  defined(TWINOAKS_COREDX)
+        dr_qos.representation.value.clear( );
+        dr_qos.representation.value.push_back( options->data_representation );
+
+#elif   defined(OPENDDS)
+        dr_qos.representation.value.length(1);
+        dr_qos.representation.value[0] = options->data_representation;
+#endif
+#if !defined(EPROSIMA_FAST_DDS)
+        LOG_MESSAGE("    DataRepresentation = " + QosUtils::to_string(dr_qos.representation FIELD_ACCESSOR.value[0]), Verbosity::DEBUG);
+#endif
+        if ( options->ownership_strength != -1 ) {
+            dr_qos.ownership FIELD_ACCESSOR.kind = EXCLUSIVE_OWNERSHIP_QOS;
+        }
+        LOG_MESSAGE("    Ownership = " + QosUtils::to_string(dr_qos.ownership FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        if ( options->timebasedfilter_interval > 0) {
+            dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.SECONDS_FIELD_NAME = options->timebasedfilter_interval;
+            dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.nanosec  = 0;
+        }
+        LOG_MESSAGE("    TimeBasedFilter = " + std::to_string(dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.SECONDS_FIELD_NAME), Verbosity::DEBUG);
+
+        if ( options->deadline_interval > 0 ) {
+            dr_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME = options->deadline_interval;
+            dr_qos.deadline FIELD_ACCESSOR.period.nanosec  = 0;
+        }
+        LOG_MESSAGE("    DeadlinePeriod = " + std::to_string(dr_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME), Verbosity::DEBUG);
+
+        // options->history_depth < 0 means leave default value
+        if ( options->history_depth > 0 )  {
+            dr_qos.history FIELD_ACCESSOR.kind  = KEEP_LAST_HISTORY_QOS;
+            dr_qos.history FIELD_ACCESSOR.depth = options->history_depth;
+        }
+        else if ( options->history_depth == 0 ) {
+            dr_qos.history FIELD_ACCESSOR.kind  = KEEP_ALL_HISTORY_QOS;
+        }
+        LOG_MESSAGE("    History = " + QosUtils::to_string(dr_qos.history FIELD_ACCESSOR.kind), Verbosity::DEBUG);
+        if (dr_qos.history FIELD_ACCESSOR.kind == KEEP_LAST_HISTORY_QOS){
+            LOG_MESSAGE("    HistoryDepth = " + std::to_string(dr_qos.history FIELD_ACCESSOR.depth), Verbosity::DEBUG);
+        }
+
+        configure_resource_limits(options, dr_qos);
+
+        // ShapePlainType is fixed-size and can be shared with (and loaned
+        // to) local endpoints; ShapePerfType has an unbounded payload
+        if ( options->plain_type ) {
+            CONFIGURE_DATA_SHARING(dr_qos);
+        }
+        else if ( options->perf_type ) {
+            CONFIGURE_UNBOUNDED_DATAREADER_QOS(dr_qos);
+        }
+    }
+
+    //-------------------------------------------------------------
+    // The same ResourceLimits for the writers and the readers
+    template <typename EntityQos>
+    void configure_resource_limits(ShapeOptions *options, EntityQos &qos)
+    {
+        // 0 means unlimited, < 0 leave default value
+        if ( options->max_samples >= 0 ) {
+            qos.resource_limits FIELD_ACCESSOR.max_samples =
+                    (options->max_samples == 0) ? LENGTH_UNLIMITED : options->max_samples;
+        }
+        if ( options->max_instances >= 0 ) {
+            qos.resource_limits FIELD_ACCESSOR.max_instances =
+                    (options->max_instances == 0) ? LENGTH_UNLIMITED : options->max_instances;
+        }
+        if ( options->max_samples_per_instance >= 0 ) {
+            qos.resource_limits FIELD_ACCESSOR.max_samples_per_instance =
+                    (options->max_samples_per_instance == 0)
+                    ? LENGTH_UNLIMITED : options->max_samples_per_instance;
+        }
+        LOG_MESSAGE("    ResourceLimits = max_samples "
+                + std::to_string(qos.resource_limits FIELD_ACCESSOR.max_samples)
+                + ", max_instances "
+                + std::to_string(qos.resource_limits FIELD_ACCESSOR.max_instances)
+                + ", max_samples_per_instance "
+                + std::to_string(qos.resource_limits FIELD_ACCESSOR.max_samples_per_instance),
+                Verbosity::DEBUG);
+
+        if ( options->preallocate ) {
+            if ( CONFIGURE_PREALLOCATION(qos) ) {
+                LOG_MESSAGE("    Preallocated = true", Verbosity::DEBUG);
+            }
+            else {
+                LOG_MESSAGE("warning: preallocation is not supported by this vendor, "
+                        "or needs finite resource limits", Verbosity::ERROR);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------
+    // Batching and asynchronous publishing trade latency for throughput, and
+    // a flow controller caps the bandwidth of the asynchronous publishing;
+    // publish_mode describes what the vendor accepted, for the reports.
+    void configure_publish_mode(ShapeOptions *options, DataWriterQos &dw_qos)
+    {
+        publish_mode = "";
+        if ( options->batch_samples > 0 ) {
+            if ( CONFIGURE_BATCHING(dw_qos, options->batch_samples, options->batch_flush_ms) ) {
+                publish_mode = "batches of " + std::to_string(options->batch_samples) + " samples";
+                if ( options->batch_flush_ms > 0 ) {
+                    publish_mode += " flushed after " + std::to_string(options->batch_flush_ms) + " ms";
+                }
+            }
+            else {
+                LOG_MESSAGE("warning: batching is not supported by this vendor", Verbosity::ERROR);
+            }
+        }
+        if ( options->flow_rate_kbps > 0 && CONFIGURE_FLOW_CONTROLLER(dw_qos) ) {
+            publish_mode += std::string(publish_mode.empty() ? "" : ", ")
+                    + "asynchronous, flow controlled to " + std::to_string(options->flow_rate_kbps)
+                    + " kB/s (burst " + std::to_string(options->flow_burst) + " x "
+                    + std::to_string(options->flow_period_ms) + " ms)";
+        }
+        else if ( options->async_publish ) {
+            if ( CONFIGURE_ASYNC_PUBLISH(dw_qos) ) {
+                publish_mode += publish_mode.empty() ? "asynchronous" : ", asynchronous";
+            }
+            else {
+                LOG_MESSAGE("warning: asynchronous publishing is not supported by this vendor",
+                        Verbosity::ERROR);
+            }
+        }
+        if ( publish_mode.empty() ) {
+            publish_mode = "synchronous";
+        }
+        LOG_MESSAGE("    PublishMode = " + publish_mode, Verbosity::DEBUG);
+    }
+
+    //-------------------------------------------------------------
+    bool init_publisher(ShapeOptions *options)
+    {
+        LOG_MESSAGE("Initializing Publisher", Verbosity::DEBUG);
+        DataWriterQos dw_qos;
+
+        if ( !create_publisher(options) ) {
+            return false;
+        }
+        configure_datawriter_qos(options, dw_qos);
+
+        for (int i = 0; i < options->num_threads; i++) {
+            Endpoint *endpoint = new Endpoint(options, i, i);
+            endpoints.push_back(endpoint);
+            endpoint->topic_name = get_topic_name(options, i % topics.size());
+
+            printf("Create writer for topic: %s color: %s\n", endpoint->topic_name.c_str(), options->color );
+            uint64_t resident_kb = MemoryFootprint::resident_kb();
+            endpoint->dw = dynamic_cast<SampleDataWriter *>(pub->create_datawriter( topics[i % topics.size()], dw_qos, NULL, LISTENER_STATUS_MASK_NONE));
+            endpoint->created_kb = (int64_t)(MemoryFootprint::resident_kb() - resident_kb);
+
+            if (endpoint->dw == NULL) {
+                LOG_MESSAGE("failed to create datawriter", Verbosity::ERROR);
+                return false;
+            }
+            // Only the writers printing their samples (-w) have an output,
+            // so --output count has no summary lines for the others
+            if (options->print_writer_samples) {
+                endpoint->output = output_flusher.create_output(
+                        "Writer " + std::to_string(i) + " (topic: " + endpoint->topic_name + ")",
+                        endpoint->topic_name,
+                        endpoint->dw->get_topic()->get_name() NAME_ACCESSOR);
+            }
+
+            char color_escaped[256];
+            events.emit("writer_created", endpoint->topic_name.c_str(), "\"color\":\"%s\"",
+                    EventStream::escape(options->color, color_escaped, sizeof(color_escaped)));
+        }
+
+        color = strdup(options->color);
+        da_width  = options->da_width;
+        da_height = options->da_height;
+        LOG_MESSAGE("Data Writer created", Verbosity::DEBUG);
+        LOG_MESSAGE("Color " + std::string(color), Verbosity::DEBUG);
+        LOG_MESSAGE("da_width " + std::to_string(da_width), Verbosity::DEBUG);
+        LOG_MESSAGE("da_height " + std::to_string(da_height), Verbosity::DEBUG);
+
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    bool init_subscriber(ShapeOptions *options)
+    {
+        DataReaderQos dr_qos;
+
+        if ( !create_subscriber(options) ) {
+            return false;
+        }
+        configure_datareader_qos(options, dr_qos);
+
+        // with -P -S the color is the one published, the readers take them all
+        const char *filter_color = options->publish ? NULL : options->color;
+
+        std::vector<TopicDescription *> reader_topics;
+        for (size_t i = 0; i < topics.size(); i++) {
+            if ( filter_color != NULL ) {
+                /*  filter on specified color */
+                TopicDescription *cft = create_filtered_topic(options, topics[i], get_topic_name(options, i));
+                if (cft == NULL) {
+                    LOG_MESSAGE("failed to create content filtered topic", Verbosity::ERROR);
+                    events.emit("filter_not_created", get_topic_name(options, i).c_str());
+                    return false;
                 }
-            case '?':
-                {
-                    parse_ok = false;
-                    break;
+                reader_topics.push_back(cft);
+            }
+            else {
+                reader_topics.push_back(topics[i]);
+            }
+        }
+
+        for (int i = 0; i < options->num_threads; i++) {
+            // readers run on the threads after the writers' with -P -S
+            int thread_index = i + (options->publish ? options->num_threads : 0);
+            Endpoint *endpoint = new Endpoint(options, i, thread_index);
+            endpoints.push_back(endpoint);
+            endpoint->topic_name = get_topic_name(options, i % topics.size());
+
+            if ( filter_color != NULL ) {
+                printf("Create reader for topic: %s color: %s\n", endpoint->topic_name.c_str(), filter_color );
+            }
+            else  {
+                printf("Create reader for topic: %s\n", endpoint->topic_name.c_str() );
+            }
+            uint64_t resident_kb = MemoryFootprint::resident_kb();
+            endpoint->dr = dynamic_cast<SampleDataReader *>(sub->create_datareader(reader_topics[i % reader_topics.size()], dr_qos, NULL, LISTENER_STATUS_MASK_NONE));
+            endpoint->created_kb = (int64_t)(MemoryFootprint::resident_kb() - resident_kb);
+
+            if (endpoint->dr == NULL) {
+                LOG_MESSAGE("failed to create datareader", Verbosity::ERROR);
+                return false;
+            }
+            // the name of a content filtered topic may differ from topic_name,
+            // but not by the suffix that keeps those of --server sessions apart
+            std::string printed_topic_name =
+                    endpoint->dr->get_topicdescription()->get_name() NAME_ACCESSOR;
+            if ( !filter_suffix.empty() && printed_topic_name.size() > filter_suffix.size()
+                    && printed_topic_name.compare(printed_topic_name.size() - filter_suffix.size(),
+                        filter_suffix.size(), filter_suffix) == 0 ) {
+                printed_topic_name.erase(printed_topic_name.size() - filter_suffix.size());
+            }
+            endpoint->output = output_flusher.create_output(
+                    "Reader " + std::to_string(i) + " (topic: " + endpoint->topic_name + ")",
+                    endpoint->topic_name, printed_topic_name);
+            LOG_MESSAGE("Data Reader created", Verbosity::DEBUG);
+
+            if ( filter_color != NULL ) {
+                char color_escaped[256];
+                events.emit("reader_created", endpoint->topic_name.c_str(), "\"color\":\"%s\"",
+                        EventStream::escape(filter_color, color_escaped, sizeof(color_escaped)));
+            }
+            else {
+                events.emit("reader_created", endpoint->topic_name.c_str());
+            }
+
+            if ( options->use_waitset || options->latency_echo ) {
+                endpoint->waiter = new DataReaderWaiter();
+                if ( !endpoint->waiter->attach(endpoint->dr) ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    TopicDescription *create_filtered_topic(ShapeOptions *options, Topic *topic, const std::string &topic_name)
+    {
+        ContentFilteredTopic *cft = NULL;
+        StringSeq              cf_params;
+
+#if   defined(RTI_CONNEXT_DDS)
+        char parameter[64];
+        sprintf(parameter, "'%s'",  options->color);
+        StringSeq_push(cf_params, parameter);
+        cft = dp->create_contentfilteredtopic((topic_name + filter_suffix).c_str(), topic, "color MATCH %0", cf_params);
+        LOG_MESSAGE("    ContentFilterTopic = color MATCH " + std::string(parameter), Verbosity::DEBUG);
+#elif defined(TWINOAKS_COREDX) || defined(OPENDDS)
+        StringSeq_push(cf_params, options->color);
+        cft = dp->create_contentfilteredtopic((topic_name + filter_suffix).c_str(), topic, "color = %0", cf_params);
+        LOG_MESSAGE("    ContentFilterTopic = color = " + std::string(options->color), Verbosity::DEBUG);
+#elif defined(EPROSIMA_FAST_DDS)
+        cf_params.push_back(std::string("'") + options->color + std::string("'"));
+        cft = dp->create_contentfilteredtopic(topic_name + "_filtered" + filter_suffix, topic, "color = %0", cf_params);
+        LOG_MESSAGE("    ContentFilterTopic = color = " + std::string(options->color), Verbosity::DEBUG);
+#endif
+        if (cft != NULL) {
+            filtered_topics.push_back(cft);
+        }
+        return cft;
+    }
+
+    //-------------------------------------------------------------
+    bool create_echo_topic(ShapeOptions *options)
+    {
+        std::string echo_topic_name = std::string(options->topic_name) + "Echo";
+        printf("Create echo topic: %s\n", echo_topic_name.c_str() );
+        echo_topic = find_or_create_topic(echo_topic_name);
+        if (echo_topic == NULL) {
+            LOG_MESSAGE("failed to create echo topic", Verbosity::ERROR);
+            return false;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    // Ping side: reader of the echoed samples
+    bool init_echo_reader(ShapeOptions *options)
+    {
+        DataReaderQos dr_qos;
+
+        if ( !create_echo_topic(options) || !create_subscriber(options) ) {
+            return false;
+        }
+        configure_datareader_qos(options, dr_qos);
+
+        printf("Create echo reader for topic: %s\n", echo_topic->get_name() NAME_ACCESSOR );
+        echo_dr = dynamic_cast<SampleDataReader *>(sub->create_datareader(echo_topic, dr_qos, NULL, LISTENER_STATUS_MASK_NONE));
+        if (echo_dr == NULL) {
+            LOG_MESSAGE("failed to create echo datareader", Verbosity::ERROR);
+            return false;
+        }
+        echo_waiter = new DataReaderWaiter();
+        return echo_waiter->attach(echo_dr);
+    }
+
+    //-------------------------------------------------------------
+    // Echo side: writer that sends every received sample back
+    bool init_echo_writer(ShapeOptions *options)
+    {
+        DataWriterQos dw_qos;
+
+        if ( !create_echo_topic(options) || !create_publisher(options) ) {
+            return false;
+        }
+        configure_datawriter_qos(options, dw_qos);
+
+        printf("Create echo writer for topic: %s\n", echo_topic->get_name() NAME_ACCESSOR );
+        echo_dw = dynamic_cast<SampleDataWriter *>(pub->create_datawriter(echo_topic, dw_qos, NULL, LISTENER_STATUS_MASK_NONE));
+        if (echo_dw == NULL) {
+            LOG_MESSAGE("failed to create echo datawriter", Verbosity::ERROR);
+            return false;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    // Runs every writer or reader on its own thread, or the only one on the
+    // main thread.
+    bool run_endpoints(ShapeOptions *options)
+    {
+        srandom((uint32_t)time(NULL));
+
+        if ( endpoints.size() == 1 ) {
+            run_endpoint(options, endpoints[0]);
+        }
+        else {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < endpoints.size(); i++) {
+                threads.push_back(std::thread(&ShapeApplication::run_endpoint,
+                        this, options, endpoints[i]));
+            }
+            for (size_t i = 0; i < threads.size(); i++) {
+                threads[i].join();
+            }
+        }
+
+        bool result = true;
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            result = result && endpoints[i]->result;
+        }
+        return result;
+    }
+
+    //-------------------------------------------------------------
+    // Reports of every writer and reader once they are all done, and the
+    // aggregate throughput when there are several of a kind
+    void print_reports(ShapeOptions *options)
+    {
+        if ( options->latency_ping || options->latency_echo ) {
+            return;
+        }
+
+        ThroughputMeter writers_aggregate;
+        ThroughputMeter readers_aggregate;
+        int             writers = 0;
+        int             readers = 0;
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            Endpoint *endpoint = endpoints[i];
+            if ( endpoints.size() > 1 ) {
+                print_endpoint_header(endpoint);
+            }
+            print_endpoint_report(options, endpoint);
+            if ( endpoint->dw != NULL ) {
+                writers_aggregate.merge(endpoint->throughput);
+                writers++;
+            }
+            else {
+                readers_aggregate.merge(endpoint->throughput);
+                readers++;
+            }
+        }
+        if ( writers > 1 && writers_aggregate.samples() > 0 ) {
+            writers_aggregate.print_report("Aggregate publisher");
+        }
+        if ( readers > 1 && readers_aggregate.samples() > 0 ) {
+            readers_aggregate.print_report("Aggregate subscriber");
+        }
+    }
+
+    //-------------------------------------------------------------
+    void print_endpoint_header(Endpoint *endpoint)
+    {
+        printf("%s %d (topic: %s, cpu: %d):\n",
+                (endpoint->dw != NULL) ? "Writer" : "Reader",
+                endpoint->index, endpoint->topic_name.c_str(), endpoint->cpu);
+    }
+
+    //-------------------------------------------------------------
+    // The report that request_reports() asked for, printed by the thread
+    // of the endpoint so that it does not race with its counters
+    void print_requested_report(ShapeOptions *options, Endpoint *endpoint)
+    {
+        if ( !endpoint->report_requested.load() ) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(report_mutex);
+            print_endpoint_header(endpoint);
+            print_endpoint_report(options, endpoint);
+            fflush(stdout);
+        }
+        endpoint->report_requested.store(false);
+    }
+
+    //-------------------------------------------------------------
+    void run_endpoint(ShapeOptions *options, Endpoint *endpoint)
+    {
+        if ( endpoint->cpu >= 0 && !pin_current_thread(endpoint->cpu) ) {
+            LOG_MESSAGE("warning: failed to pin thread to cpu "
+                    + std::to_string(endpoint->cpu), Verbosity::ERROR);
+        }
+        uint64_t resident_kb = MemoryFootprint::resident_kb();
+        if ( endpoint->dw != NULL ) {
+            endpoint->result = run_publisher(options, endpoint);
+        }
+        else {
+            endpoint->result = run_subscriber(options, endpoint);
+        }
+        endpoint->run_kb = (int64_t)(MemoryFootprint::resident_kb() - resident_kb);
+    }
+
+    //-------------------------------------------------------------
+    void print_memory_report(Endpoint *endpoint)
+    {
+        printf("%s memory (kB resident): created=%+lld run=%+lld\n",
+                (endpoint->dw != NULL) ? "Writer" : "Reader",
+                (long long)endpoint->created_kb, (long long)endpoint->run_kb);
+    }
+
+    //-------------------------------------------------------------
+    void print_endpoint_report(ShapeOptions *options, Endpoint *endpoint)
+    {
+        if ( endpoint->dw != NULL ) {
+            endpoint->pacer.print_report();
+            if ( endpoint->throughput.samples() > 0 ) {
+                endpoint->throughput.print_report("Publisher");
+            }
+            if ( endpoint->write_cost.count() > 0 ) {
+                printf("Write cost: %d instances, %s, %s samples, %s\n", options->num_instances,
+                        options->write_handle_nil ? "HANDLE_NIL" : "registered handles",
+                        endpoint->use_loan ? "loaned" : "copied", publish_mode.c_str());
+                endpoint->write_cost.print_report("Write");
+            }
+            if ( endpoint->write_failures > 0 ) {
+                printf("Write failures: %llu\n", (unsigned long long)endpoint->write_failures);
+            }
+            endpoint->allocations.print_report("write()");
+            print_memory_report(endpoint);
+            return;
+        }
+
+        if ( endpoint->throughput.samples() > 0 ) {
+            endpoint->throughput.print_report("Subscriber");
+        }
+        const char *take_call = take_call_name(endpoint->take_mode);
+        if ( endpoint->take_calls > 0 ) {
+            printf("Take cost: %s, %.1f samples per call, up to %llu calls per pass, "
+                    "%.2f us cpu per sample\n",
+                    take_call,
+                    (double)endpoint->taken_samples / endpoint->take_calls,
+                    (unsigned long long)endpoint->max_calls_per_pass,
+                    endpoint->taken_samples > 0
+                        ? endpoint->take_cpu_ns / 1e3 / endpoint->taken_samples : 0.0);
+            endpoint->take_cost.print_report(take_call);
+            if ( endpoint->release_cost.count() > 0 ) {
+                endpoint->release_cost.print_report("take() of the read samples");
+            }
+        }
+        SampleRejectedStatus rejected;
+        if ( GET_SAMPLE_REJECTED_STATUS(endpoint->dr, rejected) == RETCODE_OK
+                && rejected.total_count > 0 ) {
+            printf("Samples rejected: %d (last reason: %d)\n",
+                    rejected.total_count, (int)rejected.last_reason);
+        }
+        endpoint->allocations.print_report(take_call);
+        print_memory_report(endpoint);
+        if ( !endpoint->accounting.empty() ) {
+            endpoint->accounting.print_report(endpoint->topic_name.c_str());
+            endpoint->one_way_latency.print_report("One-way");
+        }
+    }
+
+    //-------------------------------------------------------------
+    bool run_subscriber(ShapeOptions *options, Endpoint *endpoint)
+    {
+        endpoint->allocations.start();
+        while ( ! done() )  {
+            print_requested_report(options, endpoint);
+            if ( endpoint->waiter != NULL ) {
+                // wake up periodically anyway to notice done()
+                AllocationCount allocations = endpoint->allocations.call_start();
+                bool triggered = endpoint->waiter->wait(1000);
+                endpoint->allocations.call_end(allocations, monotonic_time_ns(), 0);
+                if ( !triggered ) {
+                    continue;
                 }
             }
 
-        }
+            take_samples(endpoint);
+
+            if ( endpoint->waiter == NULL ) {
+                usleep(100000);
+            }
+        }
+        endpoint->allocations.stop();
+
+        return true;
+    }
+
+    //-------------------------------------------------------------
+    void process_samples(Endpoint *endpoint)
+    {
+        SampleSeq       &samples      = endpoint->samples;
+        SampleInfoSeq   &sample_infos = endpoint->sample_infos;
+
+        int i;
+        for (i = 0; i < samples.length(); i++)  {
+
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
+            Sample             *sample      = &samples[i];
+            SampleInfo         *sample_info = &sample_infos[i];
+#elif defined(TWINOAKS_COREDX)
+            Sample             *sample      = samples[i];
+            SampleInfo         *sample_info = sample_infos[i];
+#elif defined(EPROSIMA_FAST_DDS)
+            const Sample       *sample      = &samples[i];
+            SampleInfo         *sample_info = &sample_infos[i];
+#endif
+
+            if (sample_info->valid_data)  {
+                startup_times.record(StartupTimes::FIRST_SAMPLE);
+                endpoint->output->sample(get_sample_color(sample),
+                        sample->x FIELD_ACCESSOR,
+                        sample->y FIELD_ACCESSOR,
+                        sample->shapesize FIELD_ACCESSOR );
+                endpoint->throughput.sample(get_sample_size(sample));
+                account_sample(endpoint, sample, sample_info);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------
+    /* Gets the available samples with endpoint->take_mode, in calls of up to
+     * take_max_samples samples, and returns each loan before the next call */
+    void take_samples(Endpoint *endpoint)
+    {
+        SampleDataReader *dr = endpoint->dr;
+
+        ReturnCode_t     retval;
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS) || defined(EPROSIMA_FAST_DDS)
+        SampleSeq       &samples      = endpoint->samples;
+        SampleInfoSeq   &sample_infos = endpoint->sample_infos;
+#elif defined(TWINOAKS_COREDX)
+        SampleSeq       *samples      = &endpoint->samples;
+        SampleInfoSeq   *sample_infos = &endpoint->sample_infos;
+#endif
+        const int        max_samples = endpoint->take_max_samples;
+
+        InstanceHandle_t previous_handle = HANDLE_NIL;
+        uint64_t         calls = 0;
+        uint64_t         cpu_start_ns = thread_cpu_time_ns();
+
+        do {
+            AllocationCount allocations = endpoint->allocations.call_start();
+            uint64_t take_start_ns = monotonic_time_ns();
+            switch (endpoint->take_mode) {
+            case TAKE_INSTANCE:
+                retval = dr->take_next_instance ( samples,
+                        sample_infos,
+                        max_samples,
+                        previous_handle,
+                        ANY_SAMPLE_STATE,
+                        ANY_VIEW_STATE,
+                        ANY_INSTANCE_STATE );
+                break;
+            case TAKE_ALL:
+                retval = dr->take ( samples,
+                        sample_infos,
+                        max_samples,
+                        ANY_SAMPLE_STATE,
+                        ANY_VIEW_STATE,
+                        ANY_INSTANCE_STATE );
+                break;
+            default:
+                retval = dr->read ( samples,
+                        sample_infos,
+                        max_samples,
+                        NOT_READ_SAMPLE_STATE,
+                        ANY_VIEW_STATE,
+                        ANY_INSTANCE_STATE );
+                break;
+            }
+
+            if (retval == RETCODE_OK) {
+                uint64_t take_end_ns = monotonic_time_ns();
+                endpoint->take_cost.record(take_end_ns - take_start_ns);
+                endpoint->allocations.call_end(allocations, take_end_ns, endpoint->samples.length());
+                endpoint->take_calls++;
+                endpoint->taken_samples += endpoint->samples.length();
+                calls++;
 
-        if ( parse_ok ) {
-            parse_ok = validate();
-        }
-        if ( !parse_ok ) {
-            print_usage(argv[0]);
-        } else {
-            std::string app_kind = publish ? "publisher" : "subscriber";
-            logger.log_message("Shape Options: "
-                    "\n    This application is a " + app_kind +
-                    "\n    DomainId = " + std::to_string(domain_id) +
-                    "\n    ReliabilityKind = " + QosUtils::to_string(reliability_kind) +
-                    "\n    DurabilityKind = " + QosUtils::to_string(durability_kind) +
-                    "\n    DataRepresentation = " + QosUtils::to_string(data_representation) +
-                    "\n    HistoryDepth = " + std::to_string(history_depth) +
-                    "\n    OwnershipStrength = " + std::to_string(ownership_strength) +
-                    "\n    TimeBasedFilterInterval = " + std::to_string(timebasedfilter_interval) +
-                    "\n    DeadlineInterval = " + std::to_string(deadline_interval) +
-                    "\n    Shapesize = " + std::to_string(shapesize) +
-                    "\n    Verbosity = " + QosUtils::to_string(logger.verbosity()),
-                    Verbosity::DEBUG);
-            if (topic_name != NULL){
-                logger.log_message("    Topic = " + std::string(topic_name),
-                        Verbosity::DEBUG);
-            }
-            if (color != NULL) {
-                logger.log_message("    Color = " + std::string(color),
-                        Verbosity::DEBUG);
+                process_samples(endpoint);
+
+                // a full batch may have left samples of this instance
+                if ( (int)endpoint->samples.length() != max_samples ) {
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS) || defined(EPROSIMA_FAST_DDS)
+                    previous_handle = endpoint->sample_infos[0].instance_handle;
+#elif defined(TWINOAKS_COREDX)
+                    previous_handle = endpoint->sample_infos[0]->instance_handle;
+#endif
+                }
+                allocations = endpoint->allocations.call_start();
+                dr->return_loan( samples, sample_infos );
+                endpoint->allocations.call_end(allocations, take_end_ns, 0);
             }
-            if (partition != NULL) {
-                logger.log_message("    Partition = " + std::string(partition), Verbosity::DEBUG);
+        } while (retval == RETCODE_OK);
+
+        if ( calls == 0 ) {
+            return;
+        }
+        if ( endpoint->take_mode == TAKE_READ ) {
+            // the samples read by this pass, the new ones stay NOT_READ
+            AllocationCount allocations = endpoint->allocations.call_start();
+            uint64_t take_start_ns = monotonic_time_ns();
+            retval = dr->take ( samples,
+                    sample_infos,
+                    LENGTH_UNLIMITED,
+                    READ_SAMPLE_STATE,
+                    ANY_VIEW_STATE,
+                    ANY_INSTANCE_STATE );
+            if (retval == RETCODE_OK) {
+                dr->return_loan( samples, sample_infos );
+                uint64_t take_end_ns = monotonic_time_ns();
+                endpoint->release_cost.record(take_end_ns - take_start_ns);
+                endpoint->allocations.call_end(allocations, take_end_ns, 0);
             }
         }
-        return parse_ok;
+        endpoint->take_cpu_ns += thread_cpu_time_ns() - cpu_start_ns;
+        endpoint->max_calls_per_pass = std::max(endpoint->max_calls_per_pass, calls);
     }
-};
 
-/*************************************************************/
-class DPListener : public DomainParticipantListener
-{
-public:
-    void on_inconsistent_topic         (Topic *topic,  const InconsistentTopicStatus &) {
-        const char *topic_name = topic->get_name() NAME_ACCESSOR;
-        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s'\n", __FUNCTION__, topic_name, type_name);
-    }
+    //-------------------------------------------------------------
+    // The timestamp is CLOCK_MONOTONIC of the publisher: the one-way latency
+    // is only meaningful when both applications run on the same host.
+    void account_sample(Endpoint *endpoint, const Sample *sample, const SampleInfo *sample_info)
+    {
+        uint64_t sequence_number;
+        uint64_t instance_sequence_number;
+        uint64_t timestamp_ns;
 
-    void on_offered_incompatible_qos(DataWriter *dw,  const OfferedIncompatibleQosStatus & status) {
-        Topic      *topic       = dw->get_topic( );
-        const char *topic_name  = topic->get_name() NAME_ACCESSOR;
-        const char *type_name   = topic->get_type_name() NAME_ACCESSOR;
-        const char *policy_name = NULL;
-        policy_name = get_qos_policy_name(status.last_policy_id);
-        printf("%s() topic: '%s'  type: '%s' : %d (%s)\n", __FUNCTION__,
-                topic_name, type_name,
-                status.last_policy_id,
-                policy_name );
+        if ( !get_sample_sequence(sample, &sequence_number, &instance_sequence_number,
+                    &timestamp_ns) ) {
+            return;
+        }
+        uint64_t now_ns = monotonic_time_ns();
+        endpoint->accounting.sample_received(sample_info->publication_handle,
+                get_sample_color(sample),
+                sequence_number, instance_sequence_number);
+        if ( now_ns >= timestamp_ns ) {
+            endpoint->one_way_latency.record(now_ns - timestamp_ns);
+        }
     }
 
-    void on_publication_matched (DataWriter *dw, const PublicationMatchedStatus & status) {
-        Topic      *topic      = dw->get_topic( );
-        const char *topic_name = topic->get_name() NAME_ACCESSOR;
-        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : matched readers %d (change = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.current_count, status.current_count_change);
+    //-------------------------------------------------------------
+    void
+    initialize_shape( Sample *shape, const char *shape_color, int shapesize)
+    {
+        TypeTraits::initialize(shape);
+        set_sample_color(shape, shape_color);
+        shape->shapesize FIELD_ACCESSOR = shapesize;
     }
 
-    void on_offered_deadline_missed (DataWriter *dw, const OfferedDeadlineMissedStatus & status) {
-        Topic      *topic      = dw->get_topic( );
-        const char *topic_name = topic->get_name() NAME_ACCESSOR;
-        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.total_count, status.total_count_change);
+    //-------------------------------------------------------------
+    // Instance 0 uses the color as given, so a single-instance publisher
+    // matches color-filtered subscribers
+    std::string get_instance_color(int n)
+    {
+        std::string instance_color(color);
+        if (n > 0) {
+            instance_color += "_" + std::to_string(n);
+        }
+        return instance_color;
     }
 
-    void on_liveliness_lost (DataWriter *dw, const LivelinessLostStatus & status) {
-        Topic      *topic      = dw->get_topic( );
-        const char *topic_name = topic->get_name() NAME_ACCESSOR;
-        const char *type_name  = topic->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.total_count, status.total_count_change);
-    }
+    //-------------------------------------------------------------
+    bool run_publisher(ShapeOptions *options, Endpoint *endpoint)
+    {
+        int num_instances = options->num_instances;
+        std::vector<Sample>           shapes(num_instances);
+        std::vector<InstanceHandle_t> handles(num_instances, HANDLE_NIL);
+        std::vector<uint64_t>         instance_sequence_numbers(num_instances, 1);
+        ShapeSimulation               simulation(da_width, da_height, options->shapesize);
+        SampleDataWriter             *dw = endpoint->dw;
 
-    void on_requested_incompatible_qos (DataReader *dr, const RequestedIncompatibleQosStatus & status) {
-        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
-        const char       *topic_name = td->get_name() NAME_ACCESSOR;
-        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
-        const char *policy_name = NULL;
-        policy_name = get_qos_policy_name(status.last_policy_id);
-        printf("%s() topic: '%s'  type: '%s' : %d (%s)\n", __FUNCTION__,
-                topic_name, type_name, status.last_policy_id,
-                policy_name);
-    }
+        for (int n = 0; n < num_instances; n++) {
+            Sample *shape = &shapes[n];
+            std::string instance_color = get_instance_color(n);
+            initialize_shape(shape, instance_color.c_str(), options->shapesize);
+            set_sample_payload(shape, options->payload_size);
 
-    void on_subscription_matched (DataReader *dr, const SubscriptionMatchedStatus & status) {
-        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
-        const char       *topic_name = td->get_name() NAME_ACCESSOR;
-        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : matched writers %d (change = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.current_count, status.current_count_change);
-    }
+            int32_t x    = random() % da_width;
+            int32_t y    = random() % da_height;
+            int32_t xvel = ((random() % 5) + 1) * ((random()%2)?-1:1);
+            int32_t yvel = ((random() % 5) + 1) * ((random()%2)?-1:1);
+            simulation.add_shape(x, y, xvel, yvel);
 
-    void on_requested_deadline_missed (DataReader *dr, const RequestedDeadlineMissedStatus & status) {
-        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
-        const char       *topic_name = td->get_name() NAME_ACCESSOR;
-        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : (total = %d, change = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.total_count, status.total_count_change);
-    }
+            if ( options->write_handle_nil ) {
+                continue;
+            }
+            // register once, so write() does not have to hash the key
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
+            handles[n] = dw->register_instance( *shape );
+#elif defined(TWINOAKS_COREDX) || defined(EPROSIMA_FAST_DDS)
+            handles[n] = dw->register_instance( shape );
+#endif
+            if ( INSTANCE_HANDLE_EQUALS(handles[n], HANDLE_NIL) ) {
+                LOG_MESSAGE("failed to register instance " + instance_color,
+                        Verbosity::ERROR);
+                return false;
+            }
+        }
+        LOG_MESSAGE("Instances: " + std::to_string(num_instances) +
+                (options->write_handle_nil ? " written with HANDLE_NIL" : " registered"),
+                Verbosity::DEBUG);
 
-    void on_liveliness_changed (DataReader *dr, const LivelinessChangedStatus & status) {
-        TopicDescription *td         = GET_TOPIC_DESCRIPTION(dr);
-        const char       *topic_name = td->get_name() NAME_ACCESSOR;
-        const char       *type_name  = td->get_type_name() NAME_ACCESSOR;
-        printf("%s() topic: '%s'  type: '%s' : (alive = %d, not_alive = %d)\n", __FUNCTION__,
-                topic_name, type_name, status.alive_count, status.not_alive_count);
+        uint64_t   sequence_number = 1;
+        int        n = 0;
+        RatePacer &pacer = endpoint->pacer;
+
+        pacer.start();
+        endpoint->allocations.start();
+        while ( ! done() )  {
+            for (int i = 0; i < pacer.burst() && !done(); i++) {
+                ReturnCode_t retval;
+                // every instance moves once per round
+                if (n == 0) {
+                    simulation.step();
+                }
+                Sample *shape = &shapes[n];
+                shape->x FIELD_ACCESSOR = simulation.x(n);
+                shape->y FIELD_ACCESSOR = simulation.y(n);
+
+                // with loans the cost includes building the sample in place
+                uint64_t write_start_ns = monotonic_time_ns();
+                Sample *sample = shape;
+                if ( endpoint->use_loan ) {
+                    sample = loan_sample(dw, shape, options->payload_size);
+                    if ( sample == NULL ) {
+                        LOG_MESSAGE("warning: loaned samples are not supported, "
+                                "falling back to copying samples", Verbosity::ERROR);
+                        endpoint->use_loan = false;
+                        sample = shape;
+                    }
+                }
+                set_sample_sequence(sample, sequence_number,
+                        instance_sequence_numbers[n], write_start_ns);
+                AllocationCount allocations = endpoint->allocations.call_start();
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
+                retval = dw->write( *sample, handles[n] );
+#elif defined(TWINOAKS_COREDX) || defined(EPROSIMA_FAST_DDS)
+                retval = dw->write( sample, handles[n] );
+#endif
+                if ( retval != RETCODE_OK && sample != shape ) {
+                    DISCARD_LOANED_SAMPLE(dw, sample);
+                }
+                uint64_t write_end_ns = monotonic_time_ns();
+                endpoint->write_cost.record(write_end_ns - write_start_ns);
+                endpoint->allocations.call_end(allocations, write_end_ns,
+                        (retval == RETCODE_OK) ? 1 : 0);
+                if (retval == RETCODE_OK) {
+                    startup_times.record(StartupTimes::FIRST_SAMPLE);
+                    pacer.sample_sent();
+                    endpoint->throughput.sample(get_sample_size(shape));
+                    sequence_number++;
+                    instance_sequence_numbers[n]++;
+                }
+                else {
+                    endpoint->write_failures++;
+                }
+                if (options->print_writer_samples)
+                    endpoint->output->sample(get_sample_color(shape),
+                                            shape->x FIELD_ACCESSOR,
+                                            shape->y FIELD_ACCESSOR,
+                                            shape->shapesize FIELD_ACCESSOR);
+                if (++n == num_instances) {
+                    n = 0;
+                }
+            }
+            // woken up early to print a report, change the rate or stop
+            while ( !pacer.wait_next_burst() && !done() ) {
+                print_requested_report(options, endpoint);
+            }
+            print_requested_report(options, endpoint);
+        }
+        endpoint->allocations.stop();
+
+        return true;
     }
 
-  void on_sample_rejected (DataReader *, const SampleRejectedStatus &) {}
-  void on_data_available (DataReader *) {}
-  void on_sample_lost (DataReader *, const SampleLostStatus &) {}
-  void on_data_on_readers (Subscriber *) {}
-};
+    //-------------------------------------------------------------
+    // Borrows a sample from the DataWriter and builds 'shape' in it, with the
+    // payload generated in place. Returns NULL when the vendor does not
+    // support loans; --loan always runs with ShapePlainType, which has no
+    // strings or sequences to allocate in the loaned buffer.
+    Sample *loan_sample(SampleDataWriter *dw, const Sample *shape, int payload_size)
+    {
+        Sample *sample = NULL;
+        if ( LOAN_SAMPLE(dw, sample) != RETCODE_OK ) {
+            return NULL;
+        }
+        initialize_shape(sample, get_sample_color(shape),
+                shape->shapesize FIELD_ACCESSOR);
+        set_sample_payload(sample, payload_size);
+        sample->x FIELD_ACCESSOR = shape->x FIELD_ACCESSOR;
+        sample->y FIELD_ACCESSOR = shape->y FIELD_ACCESSOR;
+        return sample;
+    }
 
+    //-------------------------------------------------------------
+    // Writes one sample at a time, with the sequence number in 'x', and
+    // waits for the echo subscriber to send it back on <topic_name>Echo.
+    bool run_ping(ShapeOptions *options)
+    {
+        SampleDataWriter   *dw = endpoints[0]->dw;
+        std::vector<Sample> shapes(options->num_instances);
+        LatencyHistogram    histogram;
+        uint64_t            timeouts = 0;
+        int32_t             sequence = 0;
 
-/*************************************************************/
-class ShapeApplication {
+        // the pings go round-robin over the instances
+        for (size_t n = 0; n < shapes.size(); n++) {
+            initialize_shape(&shapes[n], get_instance_color((int)n).c_str(), options->shapesize);
+            set_sample_payload(&shapes[n], options->payload_size);
+            shapes[n].y FIELD_ACCESSOR = 0;
+        }
 
-private:
-    DPListener               dp_listener;
+        RatePacer pacer(options->publish_rate, 1);
+        pacer.start();
+        while ( ! done() )  {
+            ReturnCode_t retval;
+            uint64_t     received_ns;
 
-    DomainParticipantFactory *dpf;
-    DomainParticipant        *dp;
-    Publisher                *pub;
-    Subscriber               *sub;
-    Topic                    *topic;
-    ShapeTypeDataReader      *dr;
-    ShapeTypeDataWriter      *dw;
+            sequence = (sequence + 1) & 0x7fffffff;
+            Sample &shape = shapes[sequence % shapes.size()];
+            shape.x FIELD_ACCESSOR = sequence;
 
-    char                     *color;
+            uint64_t sent_ns = monotonic_time_ns();
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
+            retval = dw->write( shape, HANDLE_NIL );
+#elif defined(TWINOAKS_COREDX) || defined(EPROSIMA_FAST_DDS)
+            retval = dw->write( &shape, HANDLE_NIL );
+#endif
+            if (retval == RETCODE_OK) {
+                startup_times.record(StartupTimes::FIRST_SAMPLE);
+                pacer.sample_sent();
+                if ( wait_for_echo(sequence, sent_ns + 1000000000ull, &received_ns) ) {
+                    histogram.record(received_ns - sent_ns);
+                } else if ( !done() ) {
+                    timeouts++;
+                }
+            }
+            pacer.wait_next_burst();
+        }
+        pacer.print_report();
+        histogram.print_report("Round-trip");
+        printf("Ping: %llu echoes received, %llu timed out\n",
+                (unsigned long long)histogram.count(),
+                (unsigned long long)timeouts);
 
-    int                        xvel;
-    int                        yvel;
-    int                        da_width;
-    int                        da_height;
+        return true;
+    }
 
-public:
     //-------------------------------------------------------------
-    ShapeApplication()
+    // Takes echoed samples until the one carrying 'sequence' arrives or the
+    // deadline (monotonic clock) expires. Stale echoes are discarded.
+    bool wait_for_echo(int32_t sequence, uint64_t deadline_ns, uint64_t *received_ns)
     {
-        dpf = NULL;
-        dp  = NULL;
+        while ( ! done() ) {
+            uint64_t now = monotonic_time_ns();
+            if (now >= deadline_ns) {
+                return false;
+            }
+            if ( !echo_waiter->wait((int)((deadline_ns - now) / 1000000) + 1) ) {
+                continue;
+            }
 
-        pub = NULL;
-        sub = NULL;
-        color = NULL;
+            ReturnCode_t     retval;
+            SampleInfoSeq    sample_infos;
+            bool             found = false;
+            SampleSeq        samples;
+#if   defined(TWINOAKS_COREDX)
+            retval = echo_dr->take( &samples, &sample_infos, LENGTH_UNLIMITED,
+                    ANY_SAMPLE_STATE, ANY_VIEW_STATE, ANY_INSTANCE_STATE );
+#else
+            retval = echo_dr->take( samples, sample_infos, LENGTH_UNLIMITED,
+                    ANY_SAMPLE_STATE, ANY_VIEW_STATE, ANY_INSTANCE_STATE );
+#endif
+            *received_ns = monotonic_time_ns();
+            if (retval != RETCODE_OK) {
+                continue;
+            }
+            for (int i = 0; i < samples.length(); i++) {
+#if   defined(TWINOAKS_COREDX)
+                if (sample_infos[i]->valid_data && samples[i]->x FIELD_ACCESSOR == sequence) {
+#else
+                if (sample_infos[i].valid_data && samples[i].x FIELD_ACCESSOR == sequence) {
+#endif
+                    found = true;
+                }
+            }
+#if   defined(TWINOAKS_COREDX)
+            echo_dr->return_loan( &samples, &sample_infos );
+#else
+            echo_dr->return_loan( samples, sample_infos );
+#endif
+            if (found) {
+                return true;
+            }
+        }
+        return false;
     }
 
     //-------------------------------------------------------------
-    ~ShapeApplication()
+    // Writes every sample received on <topic_name> back on <topic_name>Echo
+    // as soon as the WaitSet wakes up.
+    bool run_echo()
     {
-        if (dp)  dp->delete_contained_entities( );
-        if (dpf) dpf->delete_participant( dp );
+        SampleDataReader *dr     = endpoints[0]->dr;
+        uint64_t          echoed = 0;
+        uint64_t          failed = 0;
+
+        while ( ! done() )  {
+            if ( !endpoints[0]->waiter->wait(1000) ) {
+                continue;
+            }
+
+            ReturnCode_t     retval;
+            SampleInfoSeq    sample_infos;
+            SampleSeq        samples;
+#if   defined(TWINOAKS_COREDX)
+            retval = dr->take( &samples, &sample_infos, LENGTH_UNLIMITED,
+                    ANY_SAMPLE_STATE, ANY_VIEW_STATE, ANY_INSTANCE_STATE );
+#else
+            retval = dr->take( samples, sample_infos, LENGTH_UNLIMITED,
+                    ANY_SAMPLE_STATE, ANY_VIEW_STATE, ANY_INSTANCE_STATE );
+#endif
+            if (retval != RETCODE_OK) {
+                continue;
+            }
+            startup_times.record(StartupTimes::FIRST_SAMPLE);
+            for (int i = 0; i < samples.length(); i++) {
+#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
+                if (!sample_infos[i].valid_data) {
+                    continue;
+                }
+                retval = echo_dw->write( samples[i], HANDLE_NIL );
+#elif defined(TWINOAKS_COREDX)
+                if (!sample_infos[i]->valid_data) {
+                    continue;
+                }
+                retval = echo_dw->write( samples[i], HANDLE_NIL );
+#elif defined(EPROSIMA_FAST_DDS)
+                if (!sample_infos[i].valid_data) {
+                    continue;
+                }
+                retval = echo_dw->write( const_cast<Sample *>(&samples[i]), HANDLE_NIL );
+#endif
+                if (retval == RETCODE_OK) {
+                    echoed++;
+                }
+                else {
+                    failed++;
+                    LOG_MESSAGE("failed to echo a sample, retval: " + std::to_string((int)retval),
+                            Verbosity::DEBUG);
+                }
+            }
+#if   defined(TWINOAKS_COREDX)
+            dr->return_loan( &samples, &sample_infos );
+#else
+            dr->return_loan( samples, sample_infos );
+#endif
+        }
+        printf("Echo: %llu samples echoed, %llu failed\n",
+                (unsigned long long)echoed, (unsigned long long)failed);
+
+        return true;
+    }
+};
+
+/*************************************************************/
+// Heads the reports, so that they tell which transport they measured
+void print_transport(ShapeOptions *options)
+{
+    if ( options->transport != NULL ) {
+        printf("Transport: %s\n", options->transport);
+    }
+}
+
+/*************************************************************/
+template <typename TypeTraits>
+bool run_application(ShapeOptions *options)
+{
+    output_flusher.start(options->output_mode);
+
+    if ( options->publish && options->subscribe && options->separate_participants ) {
+        // intra-process, each side on its own participant: the subscriber
+        // runs on a thread of its own while the publisher runs here
+        ShapeApplication<TypeTraits> pubApp;
+        ShapeApplication<TypeTraits> subApp;
+        if ( !pubApp.initialize(options, true, false)
+                || !subApp.initialize(options, false, true) ) {
+            return false;
+        }
+        memory_footprint.record(MemoryFootprint::ENDPOINTS);
+        bool sub_result = false;
+        std::thread subscriber([&subApp, &sub_result, options]() {
+            sub_result = subApp.run(options);
+        });
+        bool pub_result = pubApp.run(options);
+        subscriber.join();
+        memory_footprint.record(MemoryFootprint::END);
+        output_flusher.stop();
+        print_transport(options);
+        pubApp.print_reports(options);
+        subApp.print_reports(options);
+        startup_times.print_report();
+        memory_footprint.print_report();
+        return pub_result && sub_result;
+    }
+
+    ShapeApplication<TypeTraits> shapeApp;
+    if ( !shapeApp.initialize(options, options->publish, options->subscribe) ) {
+        return false;
+    }
+    memory_footprint.record(MemoryFootprint::ENDPOINTS);
+    bool result = shapeApp.run(options);
+    memory_footprint.record(MemoryFootprint::END);
+    output_flusher.stop();
+    print_transport(options);
+    shapeApp.print_reports(options);
+    startup_times.print_report();
+    memory_footprint.print_report();
+    return result;
+}
+
+/*************************************************************/
+template <typename TypeTraits>
+ShapeSession *new_session(ShapeOptions *options, SharedParticipant *participant)
+{
+    ShapeApplication<TypeTraits> *app = new ShapeApplication<TypeTraits>();
+    if ( !app->initialize(options, options->publish, options->subscribe, participant) ) {
+        delete app;
+        return NULL;
+    }
+    return app;
+}
 
-        if (color) free(color);
+/*************************************************************/
+/* --server: one process that creates and deletes writers and readers on
+ * the commands read from stdin, one per line, so that a test suite pays
+ * for the process startup, the participant creation and the discovery
+ * once instead of once per test. A local socket can be attached with e.g.
+ * socat UNIX-LISTEN:/tmp/shape_main.sock EXEC:"shape_main --server".
+ *
+ *   create <name> <options> : a session with the writers or readers that
+ *                             shape_main would create with these options
+ *   delete <name>           : stops the session and prints its reports
+ *   rate <name> <samples/s> : changes the publish rate of its writers
+ *   stats <name>            : prints the reports of the session so far
+ *   list                    : prints the sessions
+ *   quit                    : (or the end of the input) deletes them all
+ *
+ * Every command is answered by a line starting with "OK" or "ERROR", after
+ * what the command printed. The sessions of a domain share its
+ * participant, which the first of them creates with its options.
+ */
+class ShapeServer {
+public:
+    ~ShapeServer()
+    {
+        end_sessions();
+        std::map<std::string, SharedParticipant *>::iterator it;
+        for (it = participants.begin(); it != participants.end(); ++it) {
+            it->second->dp->delete_contained_entities( );
+            OBTAIN_DOMAIN_PARTICIPANT_FACTORY->delete_participant( it->second->dp );
+            delete it->second;
+        }
     }
 
     //-------------------------------------------------------------
-    bool initialize(ShapeOptions *options)
+    bool run()
     {
-#ifndef OBTAIN_DOMAIN_PARTICIPANT_FACTORY
-#define OBTAIN_DOMAIN_PARTICIPANT_FACTORY DomainParticipantFactory::get_instance()
-#endif
-        DomainParticipantFactory *dpf = OBTAIN_DOMAIN_PARTICIPANT_FACTORY;
-        if (dpf == NULL) {
-            logger.log_message("failed to create participant factory (missing license?).", Verbosity::ERROR);
-            return false;
+        std::string line;
+        while ( read_command(line) && execute(line) ) {
+            fflush(stdout);
         }
-        logger.log_message("Participant Factory created", Verbosity::DEBUG);
-#ifdef CONFIGURE_PARTICIPANT_FACTORY
-        CONFIGURE_PARTICIPANT_FACTORY
-#endif
+        end_sessions();
+        return true;
+    }
 
-        dp = dpf->create_participant( options->domain_id, PARTICIPANT_QOS_DEFAULT, &dp_listener, LISTENER_STATUS_MASK_ALL );
-        if (dp == NULL) {
-            logger.log_message("failed to create participant (missing license?).", Verbosity::ERROR);
-            return false;
+private:
+    struct Session {
+        Session()
+        {
+            app      = NULL;
+            finished = false;
+            result   = false;
         }
-        logger.log_message("Participant created", Verbosity::DEBUG);
-#ifndef REGISTER_TYPE
-#define REGISTER_TYPE ShapeTypeTypeSupport::register_type
-#endif
-        REGISTER_TYPE(dp, "ShapeType");
 
-        printf("Create topic: %s\n", options->topic_name );
-        topic = dp->create_topic( options->topic_name, "ShapeType", TOPIC_QOS_DEFAULT, NULL, LISTENER_STATUS_MASK_NONE);
-        if (topic == NULL) {
-            logger.log_message("failed to create topic", Verbosity::ERROR);
-            return false;
-        }
+        std::string        name;
+        ShapeOptions       options;
+        ShapeSession      *app;
+        std::thread        thread;
+        std::atomic<bool>  finished;
+        bool               result;
+    };
 
-        if ( options->publish ) {
-            return init_publisher(options);
-        }
-        else {
-            return init_subscriber(options);
+    //-------------------------------------------------------------
+    // Polls, so that SIGINT is noticed whichever thread handled it
+    bool read_command(std::string &line)
+    {
+        while ( !all_done ) {
+            size_t end = input.find('\n');
+            if (end != std::string::npos) {
+                line = input.substr(0, end);
+                input.erase(0, end + 1);
+                return true;
+            }
+            struct pollfd pfd;
+            pfd.fd     = STDIN_FILENO;
+            pfd.events = POLLIN;
+            int ready = poll(&pfd, 1, 200);
+            if (ready < 0 && errno != EINTR) {
+                return false;
+            }
+            if (ready <= 0) {
+                continue;
+            }
+            char buffer[4096];
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                // the last command may come without its newline
+                line = input;
+                input.clear();
+                return !line.empty();
+            }
+            input.append(buffer, length);
         }
+        return false;
     }
 
     //-------------------------------------------------------------
-    bool run(ShapeOptions *options)
+    // Blank-separated words; double quotes keep blanks in a word
+    static std::vector<std::string> split_words(const std::string &line)
     {
-        if ( pub != NULL ) {
-            return run_publisher(options);
+        std::vector<std::string> words;
+        std::string word;
+        bool in_word   = false;
+        bool in_quotes = false;
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (c == '"') {
+                in_quotes = !in_quotes;
+                in_word   = true;
+            }
+            else if (isspace((unsigned char)c) && !in_quotes) {
+                if (in_word) {
+                    words.push_back(word);
+                    word.clear();
+                    in_word = false;
+                }
+            }
+            else {
+                word += c;
+                in_word = true;
+            }
         }
-        else if ( sub != NULL ) {
-            return run_subscriber();
+        if (in_word) {
+            words.push_back(word);
         }
-
-        return false;
+        return words;
     }
 
     //-------------------------------------------------------------
-    bool init_publisher(ShapeOptions *options)
+    // Returns false on quit
+    bool execute(const std::string &line)
     {
-        logger.log_message("Initializing Publisher", Verbosity::DEBUG);
-        PublisherQos  pub_qos;
-        DataWriterQos dw_qos;
-        ShapeType     shape;
-
-        dp->get_default_publisher_qos( pub_qos );
-        if ( options->partition != NULL ) {
-            ADD_PARTITION(pub_qos.partition, options->partition);
+        std::vector<std::string> words = split_words(line);
+        if ( words.empty() || words[0][0] == '#' ) {
+            return true;
         }
-
-        pub = dp->create_publisher(pub_qos, NULL, LISTENER_STATUS_MASK_NONE);
-        if (pub == NULL) {
-            logger.log_message("failed to create publisher", Verbosity::ERROR);
+        const std::string &command = words[0];
+        if ( command == "quit" ) {
             return false;
         }
-        logger.log_message("Publisher created", Verbosity::DEBUG);
-        logger.log_message("Data Writer QoS:", Verbosity::DEBUG);
-        pub->get_default_datawriter_qos( dw_qos );
-        dw_qos.reliability FIELD_ACCESSOR.kind = options->reliability_kind;
-        logger.log_message("    Reliability = " + QosUtils::to_string(dw_qos.reliability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        dw_qos.durability FIELD_ACCESSOR.kind  = options->durability_kind;
-        logger.log_message("    Durability = " + QosUtils::to_string(dw_qos.durability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-
-#if   defined(RTI_CONNEXT_DDS)
-        DataRepresentationIdSeq data_representation_seq;
-        data_representation_seq.ensure_length(1,1);
-        data_representation_seq[0] = options->data_representation;
-        dw_qos.representation.value = data_representation_seq;
-
-#elif  defined(TWINOAKS_COREDX)
-        dw_qos.representation.value.clear( );
-        dw_qos.representation.value.push_back( options->data_representation );
-        
-#elif   defined(OPENDDS)
-        dw_qos.representation.value.length(1);
-        dw_qos.representation.value[0] = options->data_representation;
-#endif
-#if !defined(EPROSIMA_FAST_DDS)
-        logger.log_message("    Data_Representation = " + QosUtils::to_string(dw_qos.representation  FIELD_ACCESSOR.value[0]), Verbosity::DEBUG);
-#endif
-        if ( options->ownership_strength != -1 ) {
-            dw_qos.ownership FIELD_ACCESSOR.kind = EXCLUSIVE_OWNERSHIP_QOS;
-            dw_qos.ownership_strength FIELD_ACCESSOR.value = options->ownership_strength;
+        if ( command == "list" ) {
+            list_sessions();
+            return true;
         }
-
-        if ( options->ownership_strength == -1 ) {
-            dw_qos.ownership  FIELD_ACCESSOR.kind = SHARED_OWNERSHIP_QOS;
+        if ( command != "create" && command != "delete"
+                && command != "rate" && command != "stats" ) {
+            reply_error(command, "", "unknown command");
+            return true;
         }
-        logger.log_message("    Ownership = " + QosUtils::to_string(dw_qos.ownership FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        if (dw_qos.ownership FIELD_ACCESSOR.kind == EXCLUSIVE_OWNERSHIP_QOS){
-            logger.log_message("    OwnershipStrength = " + std::to_string(dw_qos.ownership_strength FIELD_ACCESSOR.value), Verbosity::DEBUG);
+        if ( words.size() < 2 ) {
+            reply_error(command, "", "missing session name");
+            return true;
         }
-
-        if ( options->deadline_interval > 0 ) {
-            dw_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME = options->deadline_interval;
-            dw_qos.deadline FIELD_ACCESSOR.period.nanosec  = 0;
+        if ( command == "create" ) {
+            create_session(words);
+            return true;
         }
-        logger.log_message("    DeadlinePeriod = " + std::to_string(dw_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME), Verbosity::DEBUG);
-
-        // options->history_depth < 0 means leave default value
-        if ( options->history_depth > 0 )  {
-            dw_qos.history FIELD_ACCESSOR.kind  = KEEP_LAST_HISTORY_QOS;
-            dw_qos.history FIELD_ACCESSOR.depth = options->history_depth;
+        std::map<std::string, Session *>::iterator it = sessions.find(words[1]);
+        if ( it == sessions.end() ) {
+            reply_error(command, words[1], "no such session");
         }
-        else if ( options->history_depth == 0 ) {
-            dw_qos.history FIELD_ACCESSOR.kind  = KEEP_ALL_HISTORY_QOS;
+        else if ( command == "delete" ) {
+            Session *session = it->second;
+            sessions.erase(it);
+            if ( end_session(session) ) {
+                reply_ok(command, words[1]);
+            }
+            else {
+                reply_error(command, words[1], "the session failed");
+            }
         }
-        logger.log_message("    History = " + QosUtils::to_string(dw_qos.history FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        if (dw_qos.history FIELD_ACCESSOR.kind == KEEP_LAST_HISTORY_QOS){
-            logger.log_message("    HistoryDepth = " + std::to_string(dw_qos.history FIELD_ACCESSOR.depth), Verbosity::DEBUG);
+        else if ( command == "rate" ) {
+            set_rate(it->second, words);
         }
-
-        printf("Create writer for topic: %s color: %s\n", options->topic_name, options->color );
-        dw = dynamic_cast<ShapeTypeDataWriter *>(pub->create_datawriter( topic, dw_qos, NULL, LISTENER_STATUS_MASK_NONE));
-
-        if (dw == NULL) {
-            logger.log_message("failed to create datawriter", Verbosity::ERROR);
-            return false;
+        else {
+            print_stats(it->second);
         }
-
-        color = strdup(options->color);
-        xvel = options->xvel;
-        yvel = options->yvel;
-        da_width  = options->da_width;
-        da_height = options->da_height;
-        logger.log_message("Data Writer created", Verbosity::DEBUG);
-        logger.log_message("Color " + std::string(color), Verbosity::DEBUG);
-        logger.log_message("xvel " + std::to_string(xvel), Verbosity::DEBUG);
-        logger.log_message("yvel " + std::to_string(yvel), Verbosity::DEBUG);
-        logger.log_message("da_width " + std::to_string(da_width), Verbosity::DEBUG);
-        logger.log_message("da_height " + std::to_string(da_height), Verbosity::DEBUG);
-
         return true;
     }
 
     //-------------------------------------------------------------
-    bool init_subscriber(ShapeOptions *options)
+    void create_session(const std::vector<std::string> &words)
     {
-        SubscriberQos sub_qos;
-        DataReaderQos dr_qos;
-
-        dp->get_default_subscriber_qos( sub_qos );
-        if ( options->partition != NULL ) {
-            ADD_PARTITION(sub_qos.partition, options->partition);
+        // they would act on the whole process
+        static const char *unsupported[] = {
+            "--help", "--server", "--separate-participants", "--output", "--events", NULL
+        };
+        const std::string &name = words[1];
+        if ( sessions.count(name) > 0 ) {
+            reply_error(words[0], name, "the session already exists");
+            return;
         }
-
-        sub = dp->create_subscriber( sub_qos, NULL, LISTENER_STATUS_MASK_NONE );
-        if (sub == NULL) {
-            logger.log_message("failed to create subscriber", Verbosity::ERROR);
-            return false;
+        std::vector<char *> argv;
+        argv.push_back((char *)"create");
+        for (size_t i = 2; i < words.size(); i++) {
+            bool supported = (words[i] != "-h");
+            for (int j = 0; supported && unsupported[j] != NULL; j++) {
+                supported = words[i].compare(0, strlen(unsupported[j]), unsupported[j]) != 0;
+            }
+            if ( !supported ) {
+                reply_error(words[0], name, words[i] + " is not supported in sessions");
+                return;
+            }
+            argv.push_back((char *)words[i].c_str());
         }
-        logger.log_message("Subscriber created", Verbosity::DEBUG);
-        logger.log_message("Data Reader QoS:", Verbosity::DEBUG);
-        sub->get_default_datareader_qos( dr_qos );
-        dr_qos.reliability FIELD_ACCESSOR.kind = options->reliability_kind;
-        logger.log_message("    Reliability = " + QosUtils::to_string(dr_qos.reliability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        dr_qos.durability FIELD_ACCESSOR.kind  = options->durability_kind;
-        logger.log_message("    Durability = " + QosUtils::to_string(dr_qos.durability FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-
-#if   defined(RTI_CONNEXT_DDS)
-        DataRepresentationIdSeq data_representation_seq;
-        data_representation_seq.ensure_length(1,1);
-        data_representation_seq[0] = options->data_representation;
-        dr_qos.representation.value = data_representation_seq;
-#elif  defined(TWINOAKS_COREDX)
-        dr_qos.representation.value.clear( );
-        dr_qos.representation.value.push_back( options->data_representation );
+        argv.push_back(NULL);
 
-#elif   defined(OPENDDS)
-        dr_qos.representation.value.length(1);
-        dr_qos.representation.value[0] = options->data_representation;
-#endif
-#if !defined(EPROSIMA_FAST_DDS)
-        logger.log_message("    DataRepresentation = " + QosUtils::to_string(dr_qos.representation FIELD_ACCESSOR.value[0]), Verbosity::DEBUG);
-#endif
-        if ( options->ownership_strength != -1 ) {
-            dr_qos.ownership FIELD_ACCESSOR.kind = EXCLUSIVE_OWNERSHIP_QOS;
+        Session *session = new Session();
+        session->name = name;
+        optind = 0;     /* getopt_long starts over */
+        if ( !session->options.parse((int)argv.size() - 1, &argv[0]) ) {
+            delete session;
+            reply_error(words[0], name, "incorrect options");
+            return;
         }
-        logger.log_message("    Ownership = " + QosUtils::to_string(dr_qos.ownership FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        if ( options->timebasedfilter_interval > 0) {
-            dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.SECONDS_FIELD_NAME = options->timebasedfilter_interval;
-            dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.nanosec  = 0;
+        SharedParticipant *participant = get_participant(&session->options);
+        if ( participant != NULL ) {
+            if ( session->options.plain_type ) {
+                session->app = new_session<ShapePlainTypeTraits>(&session->options, participant);
+            }
+            else if ( session->options.perf_type ) {
+                session->app = new_session<ShapePerfTypeTraits>(&session->options, participant);
+            }
+            else {
+                session->app = new_session<ShapeTypeTraits>(&session->options, participant);
+            }
         }
-        logger.log_message("    TimeBasedFilter = " + std::to_string(dr_qos.time_based_filter FIELD_ACCESSOR.minimum_separation.SECONDS_FIELD_NAME), Verbosity::DEBUG);
+        if ( session->app == NULL ) {
+            delete session;
+            reply_error(words[0], name, "failed to create the writers and readers");
+            return;
+        }
+        session->thread = std::thread(&ShapeServer::run_session, session);
+        sessions[name] = session;
+        reply_ok(words[0], name);
+    }
 
-        if ( options->deadline_interval > 0 ) {
-            dr_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME = options->deadline_interval;
-            dr_qos.deadline FIELD_ACCESSOR.period.nanosec  = 0;
+    //-------------------------------------------------------------
+    static void run_session(Session *session)
+    {
+        session->result   = session->app->run(&session->options);
+        session->finished = true;
+    }
+
+    //-------------------------------------------------------------
+    SharedParticipant *get_participant(ShapeOptions *options)
+    {
+        std::string key = participant_key(options);
+        std::map<std::string, SharedParticipant *>::iterator it =
+                participants.find(key);
+        if ( it != participants.end() ) {
+            return it->second;
+        }
+        SharedParticipant *participant = new SharedParticipant();
+        participant->dp = create_participant(options, &participant->listener, options->publish);
+        if ( participant->dp == NULL ) {
+            delete participant;
+            return NULL;
         }
-        logger.log_message("    DeadlinePeriod = " + std::to_string(dr_qos.deadline FIELD_ACCESSOR.period.SECONDS_FIELD_NAME), Verbosity::DEBUG);
+        LOG_MESSAGE("Participant for domain " + key, Verbosity::DEBUG);
+        participants[key] = participant;
+        return participant;
+    }
 
-        // options->history_depth < 0 means leave default value
-        if ( options->history_depth > 0 )  {
-            dr_qos.history FIELD_ACCESSOR.kind  = KEEP_LAST_HISTORY_QOS;
-            dr_qos.history FIELD_ACCESSOR.depth = options->history_depth;
+    //-------------------------------------------------------------
+    // The domain and the options applied to the participant: sessions
+    // share a participant only when they agree on all of them, the others
+    // get one of their own, as separate applications would
+    static std::string participant_key(const ShapeOptions *options)
+    {
+        std::string key = std::to_string(options->domain_id);
+        for (size_t i = 0; i < options->peers.size(); i++) {
+            key += " --peer " + options->peers[i];
         }
-        else if ( options->history_depth == 0 ) {
-            dr_qos.history FIELD_ACCESSOR.kind  = KEEP_ALL_HISTORY_QOS;
+        if ( options->announcement_period_ms > 0 ) {
+            key += " --announcement-period " + std::to_string(options->announcement_period_ms);
         }
-        logger.log_message("    History = " + QosUtils::to_string(dr_qos.history FIELD_ACCESSOR.kind), Verbosity::DEBUG);
-        if (dr_qos.history FIELD_ACCESSOR.kind == KEEP_LAST_HISTORY_QOS){
-            logger.log_message("    HistoryDepth = " + std::to_string(dr_qos.history FIELD_ACCESSOR.depth), Verbosity::DEBUG);
+        if ( options->no_multicast ) {
+            key += " --no-multicast";
         }
-
-        if ( options->color != NULL ) {
-            /*  filter on specified color */
-            ContentFilteredTopic *cft = NULL;
-            StringSeq              cf_params;
-
-#if   defined(RTI_CONNEXT_DDS)
-            char parameter[64];
-            sprintf(parameter, "'%s'",  options->color);
-            StringSeq_push(cf_params, parameter);
-            cft = dp->create_contentfilteredtopic(options->topic_name, topic, "color MATCH %0", cf_params);
-            logger.log_message("    ContentFilterTopic = color MATCH " + std::string(parameter), Verbosity::DEBUG);
-#elif defined(TWINOAKS_COREDX) || defined(OPENDDS)
-            StringSeq_push(cf_params, options->color);
-            cft = dp->create_contentfilteredtopic(options->topic_name, topic, "color = %0", cf_params);
-            logger.log_message("    ContentFilterTopic = color = " + std::string(options->color), Verbosity::DEBUG);
-#elif defined(EPROSIMA_FAST_DDS)
-            cf_params.push_back(std::string("'") + options->color + std::string("'"));
-            cft = dp->create_contentfilteredtopic(std::string(options->topic_name) + "_filtered", topic, "color = %0", cf_params);
-            logger.log_message("    ContentFilterTopic = color = " + std::string(options->color), Verbosity::DEBUG);
-#endif
-            if (cft == NULL) {
-                logger.log_message("failed to create content filtered topic", Verbosity::ERROR);
-                return false;
+        if ( options->transport != NULL ) {
+            // the TCP transport listens or connects depending on -P
+            key += " -T " + std::string(options->transport) + (options->publish ? " -P" : "");
+            if ( options->tcp_port > 0 ) {
+                key += " --tcp-port " + std::to_string(options->tcp_port);
             }
-
-            printf("Create reader for topic: %s color: %s\n", options->topic_name, options->color );
-            dr = dynamic_cast<ShapeTypeDataReader *>(sub->create_datareader(cft, dr_qos, NULL, LISTENER_STATUS_MASK_NONE));
         }
-        else  {
-            printf("Create reader for topic: %s\n", options->topic_name );
-            dr = dynamic_cast<ShapeTypeDataReader *>(sub->create_datareader(topic, dr_qos, NULL, LISTENER_STATUS_MASK_NONE));
+        if ( options->flow_rate_kbps > 0 ) {
+            key += " --flow-rate " + std::to_string(options->flow_rate_kbps)
+                    + " --flow-period " + std::to_string(options->flow_period_ms)
+                    + " --flow-burst " + std::to_string(options->flow_burst);
         }
+        return key;
+    }
 
+    //-------------------------------------------------------------
+    // Stops the session and prints its reports; false if it failed
+    static bool end_session(Session *session)
+    {
+        session->app->stop();
+        session->thread.join();
+        session->app->print_reports(&session->options);
+        bool result = session->result;
+        delete session->app;
+        delete session;
+        return result;
+    }
 
-        if (dr == NULL) {
-            logger.log_message("failed to create datareader", Verbosity::ERROR);
-            return false;
+    //-------------------------------------------------------------
+    void end_sessions()
+    {
+        std::map<std::string, Session *>::iterator it;
+        for (it = sessions.begin(); it != sessions.end(); ++it) {
+            end_session(it->second);
         }
-        logger.log_message("Data Reader created", Verbosity::DEBUG);
-        return true;
+        sessions.clear();
     }
 
     //-------------------------------------------------------------
-    bool run_subscriber()
+    void set_rate(Session *session, const std::vector<std::string> &words)
     {
-        while ( ! all_done )  {
-            ReturnCode_t     retval;
-            SampleInfoSeq    sample_infos;
-
-#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
-            ShapeTypeSeq          samples;
-#elif defined(TWINOAKS_COREDX)
-            ShapeTypePtrSeq       samples;
-#elif defined(EPROSIMA_FAST_DDS)
-            FASTDDS_CONST_SEQUENCE(DataSeq, ShapeType);
-            DataSeq samples;
-#endif
-
-            InstanceHandle_t previous_handle = HANDLE_NIL;
-
-            do {
-#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS) || defined(EPROSIMA_FAST_DDS)
-                retval = dr->take_next_instance ( samples,
-                        sample_infos,
-                        LENGTH_UNLIMITED,
-                        previous_handle,
-                        ANY_SAMPLE_STATE,
-                        ANY_VIEW_STATE,
-                        ANY_INSTANCE_STATE );
-#elif defined(TWINOAKS_COREDX)
-                retval = dr->take_next_instance ( &samples,
-                        &sample_infos,
-                        LENGTH_UNLIMITED,
-                        previous_handle,
-                        ANY_SAMPLE_STATE,
-                        ANY_VIEW_STATE,
-                        ANY_INSTANCE_STATE );
-#endif
-
-                if (retval == RETCODE_OK) {
-                    int i;
-                    for (i = 0; i < samples.length(); i++)  {
-
-#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
-                        ShapeType          *sample      = &samples[i];
-                        SampleInfo         *sample_info = &sample_infos[i];
-#elif defined(TWINOAKS_COREDX)
-                        ShapeType          *sample      = samples[i];
-                        SampleInfo         *sample_info = sample_infos[i];
-#elif defined(EPROSIMA_FAST_DDS)
-                        const ShapeType    *sample      = &samples[i];
-                        SampleInfo         *sample_info = &sample_infos[i];
-#endif
-
-                        if (sample_info->valid_data)  {
-                            printf("%-10s %-10s %03d %03d [%d]\n", dr->get_topicdescription()->get_name() NAME_ACCESSOR,
-                                    sample->color FIELD_ACCESSOR STRING_IN,
-                                    sample->x FIELD_ACCESSOR,
-                                    sample->y FIELD_ACCESSOR,
-                                    sample->shapesize FIELD_ACCESSOR );
-                        }
-                    }
-
-#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS) || defined(EPROSIMA_FAST_DDS)
-                    previous_handle = sample_infos[0].instance_handle;
-                    dr->return_loan( samples, sample_infos );
-#elif defined(TWINOAKS_COREDX)
-                    previous_handle = sample_infos[0]->instance_handle;
-                    dr->return_loan( &samples, &sample_infos );
-#endif
-                }
-            } while (retval == RETCODE_OK);
-
-            usleep(100000);
+        double rate = 0;
+        if ( words.size() < 3 || sscanf(words[2].c_str(), "%lf", &rate) != 1
+                || !RatePacer::valid_rate(rate) ) {
+            reply_error(words[0], session->name, "please specify the samples per second");
+        }
+        else if ( !session->app->set_rate(rate) ) {
+            reply_error(words[0], session->name, "no writer to pace");
+        }
+        else {
+            reply_ok(words[0], session->name);
         }
-
-        return true;
     }
 
     //-------------------------------------------------------------
-    void
-    moveShape( ShapeType *shape)
+    // The threads of the writers and readers print the reports, this one
+    // waits for them
+    void print_stats(Session *session)
     {
-        int w2;
-
-        w2 = 1 + shape->shapesize FIELD_ACCESSOR / 2;
-        shape->x FIELD_ACCESSOR = shape->x FIELD_ACCESSOR + xvel;
-        shape->y FIELD_ACCESSOR = shape->y FIELD_ACCESSOR + yvel;
-        if (shape->x FIELD_ACCESSOR < w2) {
-            shape->x FIELD_ACCESSOR = w2;
-            xvel = -xvel;
-        }
-        if (shape->x FIELD_ACCESSOR > da_width - w2) {
-            shape->x FIELD_ACCESSOR = (da_width - w2);
-            xvel = -xvel;
+        if ( session->finished ) {
+            reply_error("stats", session->name, "the session has ended, delete it for its reports");
+            return;
         }
-        if (shape->y FIELD_ACCESSOR < w2) {
-            shape->y FIELD_ACCESSOR = w2;
-            yvel = -yvel;
+        if ( !session->app->request_reports() ) {
+            reply_error("stats", session->name, "no reports with --ping or --echo");
+            return;
         }
-        if (shape->y FIELD_ACCESSOR > (da_height - w2) )  {
-            shape->y FIELD_ACCESSOR = (da_height - w2);
-            yvel = -yvel;
+        while ( session->app->reports_pending() && !session->finished && !all_done ) {
+            usleep(10000);
         }
+        reply_ok("stats", session->name);
     }
 
     //-------------------------------------------------------------
-    bool run_publisher(ShapeOptions *options)
+    void list_sessions()
     {
-        ShapeType shape;
-#if defined(RTI_CONNEXT_DDS)
-        ShapeType_initialize(&shape);
-#endif
-
-        srandom((uint32_t)time(NULL));
+        std::map<std::string, Session *>::iterator it;
+        for (it = sessions.begin(); it != sessions.end(); ++it) {
+            ShapeOptions *options = &it->second->options;
+            printf("%s: %s of %s on domain %d, %s\n", it->first.c_str(),
+                    (options->publish && options->subscribe) ? "publisher and subscriber"
+                    : options->publish ? "publisher" : "subscriber",
+                    options->topic_name, (int)options->domain_id,
+                    it->second->finished ? "ended" : "running");
+        }
+        reply_ok("list", "");
+    }
 
-#ifndef STRING_ALLOC
-#define STRING_ALLOC(A, B)
-#endif
-        STRING_ALLOC(shape.color, std::strlen(color));
-#ifndef STRING_ASSIGN
-        strcpy(shape.color STRING_INOUT, color);
-#else
-        STRING_ASSIGN(shape.color, color);
-#endif
+    //-------------------------------------------------------------
+    static void reply_ok(const std::string &command, const std::string &name)
+    {
+        printf("OK %s%s%s\n", command.c_str(), name.empty() ? "" : " ", name.c_str());
+    }
 
-        shape.shapesize FIELD_ACCESSOR = options->shapesize;
-        shape.x FIELD_ACCESSOR =  random() % da_width;
-        shape.y FIELD_ACCESSOR =  random() % da_height;
-        xvel                   =  ((random() % 5) + 1) * ((random()%2)?-1:1);
-        yvel                   =  ((random() % 5) + 1) * ((random()%2)?-1:1);;
+    static void reply_error(const std::string &command, const std::string &name,
+            const std::string &reason)
+    {
+        printf("ERROR %s%s%s: %s\n", command.c_str(), name.empty() ? "" : " ",
+                name.c_str(), reason.c_str());
+    }
 
-        while ( ! all_done )  {
-            moveShape(&shape);
-#if   defined(RTI_CONNEXT_DDS) || defined(OPENDDS)
-            dw->write( shape, HANDLE_NIL );
-#elif defined(TWINOAKS_COREDX) || defined(EPROSIMA_FAST_DDS)
-            dw->write( &shape, HANDLE_NIL );
-#endif
-            if (options->print_writer_samples)
-                printf("%-10s %-10s %03d %03d [%d]\n", dw->get_topic()->get_name() NAME_ACCESSOR,
-                                        shape.color FIELD_ACCESSOR STRING_IN,
-                                        shape.x FIELD_ACCESSOR,
-                                        shape.y FIELD_ACCESSOR,
-                                        shape.shapesize FIELD_ACCESSOR);
-            usleep(33000);
-        }
+    std::string                                input;
+    std::map<std::string, Session *>           sessions;
+    std::map<std::string, SharedParticipant *> participants;  /* see participant_key */
+};
 
-        return true;
+/*************************************************************/
+bool run_server(ShapeOptions *options)
+{
+    output_flusher.start(options->output_mode);
+    bool result;
+    {
+        ShapeServer server;
+        result = server.run();
+        memory_footprint.record(MemoryFootprint::END);
     }
-};
+    output_flusher.stop();
+    startup_times.print_report();
+    memory_footprint.print_report();
+    return result;
+}
 
 /*************************************************************/
 int main( int argc, char * argv[] )
 {
+    startup_times.start();
+    memory_footprint.record(MemoryFootprint::START);
     install_sig_handlers();
 
     ShapeOptions options;
@@ -1151,14 +5528,24 @@ int main( int argc, char * argv[] )
     if ( !parseResult  ) {
         exit(1);
     }
-    ShapeApplication shapeApp;
-    if ( !shapeApp.initialize(&options) ) {
-        exit(2);
+    bool runResult;
+    if ( options.server ) {
+        runResult = run_server(&options);
+    }
+    else if ( options.plain_type ) {
+        runResult = run_application<ShapePlainTypeTraits>(&options);
+    }
+    else if ( options.perf_type ) {
+        runResult = run_application<ShapePerfTypeTraits>(&options);
+    }
+    else {
+        runResult = run_application<ShapeTypeTraits>(&options);
     }
-    if ( !shapeApp.run(&options) ) {
+    if ( !runResult ) {
         exit(2);
     }
 
+    events.emit("done", options.server ? "" : options.topic_name);
     printf("Done.\n");
 
     return 0;
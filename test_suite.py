@@ -7,8 +7,9 @@
 #
 #################################################################
 
-from rtps_test_utilities import ReturnCode, log_message
+from rtps_test_utilities import ReturnCode, log_message, parse_performance_report
 import re
+import signal
 import pexpect
 # rtps_test_suite_1 is a dictionary that defines the TestSuite. Each element of
 # the dictionary is a Test Case that the interoperability_report.py
@@ -114,44 +115,36 @@ def test_reliability_4(child_sub, samples_sent, timeout):
 
     """
     This function tests reliability, it checks whether the Subscriber receives
-    the samples in order.
+    every sample once and in order. Both applications use ShapePerfType
+    (--perf-type), so the Subscriber counts the samples lost, reordered and
+    duplicated of each writer and each instance from their sequence numbers.
+    It lets the Subscriber receive samples for a while, stops it so that it
+    prints those counters and checks that all of them are 0.
 
     child_sub: child program generated with pexpect
     samples_sent: list of multiprocessing Queues with the samples
                 the Publishers send. Element 1 of the list is for
-                Publisher 1, etc.
+                Publisher 1, etc. Not used.
     timeout: time pexpect waits until it matches a pattern.
     """
-    max_samples_received = 3
-    max_wait_time = 5
-    for x in range(0, max_samples_received, 1):
-        # take the position of the samples
-        sub_string = re.search('[0-9]{3} [0-9]{3} \[[0-9]{2}\]',
-            child_sub.before + child_sub.after)
-        # the function takes the samples the first publisher is sending
-        # ('samples_sent[0]') and checks whether they match the
-        # samples that the subscriber has received.
-        # In the case that 'samples_sent[0]' is empty, the method get()
-        # waits <max_wait_time> to stop the execution of the loop.
-        try:
-            if samples_sent[0].get(block=True,timeout=max_wait_time) == sub_string.group(0):
-                produced_code = ReturnCode.OK
-            else:
-                produced_code = ReturnCode.DATA_NOT_CORRECT
-                break
-        except:
-            print("No samples to take from Queue")
-            break
-
-        # Get the next samples the subscriber is receiving
-        child_sub.expect(
-            [
-                '\[[0-9]{2}\]', # index = 0
-                pexpect.TIMEOUT # index = 1
-            ],
-            timeout
-        )
-    return produced_code
+    receive_time = 5
+    child_sub.expect([pexpect.TIMEOUT, pexpect.EOF], receive_time)
+    child_sub.kill(signal.SIGINT)
+    child_sub.expect([pexpect.EOF, pexpect.TIMEOUT], timeout)
+    child_sub.logfile.seek(0)
+    metrics = parse_performance_report(child_sub.logfile.read())
+
+    counters = ['samples_lost', 'samples_reordered', 'samples_duplicated',
+            'instance_samples_lost', 'instance_samples_reordered',
+            'instance_samples_duplicated']
+    if any(name not in metrics for name in counters):
+        print('No sample accounting reported')
+        return ReturnCode.DATA_NOT_CORRECT
+    wrong = [f'{name}={metrics[name]}' for name in counters if metrics[name] != 0]
+    if wrong:
+        print(f'Samples not received once and in order: {", ".join(wrong)}')
+        return ReturnCode.DATA_NOT_CORRECT
+    return ReturnCode.OK
 
 rtps_test_suite_1 = {
     # DATA REPRESENTATION
@@ -173,7 +166,7 @@ rtps_test_suite_1 = {
     # This test only checks that data is received correctly
     'Test_Reliability_3' : [['-P -t Square -r -k 3 -x 2', '-S -t Square -r -x 2'], [ReturnCode.OK, ReturnCode.OK]],
     # This test checks that data is received in the right order
-    'Test_Reliability_4' : [['-P -t Square -r -k 0 -w -x 2', '-S -t Square -r -k 0 -x 2'], [ReturnCode.OK, ReturnCode.OK], test_reliability_4],
+    'Test_Reliability_4' : [['-P -t Square -r -k 0 -x 2 --perf-type', '-S -t Square -r -k 0 -x 2 --perf-type'], [ReturnCode.OK, ReturnCode.OK], test_reliability_4],
 
     # DEADLINE
     'Test_Deadline_0' : [['-P -t Square -f 3 -x 2', '-S -t Square -f 5 -x 2'], [ReturnCode.OK, ReturnCode.OK]],
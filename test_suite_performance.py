@@ -0,0 +1,135 @@
+#################################################################
+# Use and redistribution is source and binary forms is permitted
+# subject to the OMG-DDS INTEROPERABILITY TESTING LICENSE found
+# at the following URL:
+#
+# https://github.com/omg-dds/dds-rtps/blob/master/LICENSE.md
+#
+#################################################################
+
+from rtps_test_utilities import ReturnCode, parse_performance_report
+import signal
+import pexpect
+# rtps_performance_suite_1 is a dictionary that defines a TestSuite of
+# performance Test Cases, in the format of test_suite.py:
+#       'name' : [[parameter_list], [expected_return_code_list], checking_function]
+# performance_test() builds them from what the Test Case measures:
+#       * qos: shape_main QoS parameters of the Publisher and the Subscriber,
+#         e.g. '-r -k 0' (RELIABLE, KEEP_ALL).
+#       * rate: samples per second the Publisher writes.
+#       * payload_size: bytes of payload of each sample (ShapePerfType).
+#       * duration: seconds the Subscriber measures, from the first sample.
+#       * thresholds (OPTIONAL): the minimum throughput of the Subscriber
+#         (samples/s), the maximum ratio of samples lost and the maximum
+#         one-way latency percentiles (us) that the Test Case accepts.
+# The metrics the shape_main applications report, and the thresholds, are
+# written as properties of the Test Case in the JUnit report, see
+# performance_matrix.py to compare them across implementations.
+
+def check_performance(
+        duration: int,
+        min_throughput: float = None,
+        max_loss_ratio: float = None,
+        max_latency_p50_us: float = None,
+        max_latency_p99_us: float = None):
+
+    """
+    This function returns the checking function of a performance Test Case.
+    The checking function lets the Subscriber receive samples for <duration>
+    seconds, stops it so that it prints its reports, and compares the
+    metrics of the reports (see parse_performance_report) with the
+    thresholds. The thresholds that are None are not checked.
+
+    The checking function has the 'thresholds' attribute, which
+    interoperability_report.py writes to the JUnit report with the metrics.
+    """
+    thresholds = {
+        'min_throughput_samples_per_s': min_throughput,
+        'max_loss_ratio': max_loss_ratio,
+        'max_latency_p50_us': max_latency_p50_us,
+        'max_latency_p99_us': max_latency_p99_us
+    }
+    thresholds = {name: value for name, value in thresholds.items()
+            if value is not None}
+
+    def check_performance(child_sub, samples_sent, timeout):
+        # keep reading the output meanwhile, so that it does not block
+        # the Subscriber
+        child_sub.expect([pexpect.TIMEOUT, pexpect.EOF], duration)
+        child_sub.kill(signal.SIGINT)
+        child_sub.expect([pexpect.EOF, pexpect.TIMEOUT], timeout)
+        child_sub.logfile.seek(0)
+        metrics = parse_performance_report(child_sub.logfile.read())
+
+        failed = []
+        if 'throughput_samples_per_s' not in metrics:
+            failed.append('no throughput reported')
+        if 'min_throughput_samples_per_s' in thresholds \
+                and metrics.get('throughput_samples_per_s', 0) \
+                    < thresholds['min_throughput_samples_per_s']:
+            failed.append('throughput')
+        for name in ['loss_ratio', 'latency_p50_us', 'latency_p99_us']:
+            if f'max_{name}' in thresholds \
+                    and metrics.get(name, float('inf')) > thresholds[f'max_{name}']:
+                failed.append(name)
+        if failed:
+            print(f'Performance below the thresholds ({", ".join(failed)}): '
+                    f'{metrics}')
+            return ReturnCode.PERFORMANCE_NOT_MET
+        return ReturnCode.OK
+
+    check_performance.thresholds = thresholds
+    return check_performance
+
+
+def performance_test(
+        qos: str,
+        rate: int,
+        payload_size: int,
+        duration: int,
+        **thresholds):
+
+    """
+    This function returns a performance Test Case: one Publisher writing
+    ShapePerfType samples of <payload_size> bytes at <rate> samples per
+    second and one Subscriber, both with the <qos> parameters, checked with
+    check_performance(duration, **thresholds).
+
+    The samples are printed asynchronously (--output async), so that the
+    console does not limit the rate, and the Subscriber waits for them on a
+    WaitSet (--waitset), so that it does not poll.
+    """
+    common = f'-t Square --perf-type --payload-size {payload_size} ' \
+            f'--output async {qos}'
+    return [[f'-P {common} --rate {rate}', f'-S {common} --waitset'],
+            [ReturnCode.OK, ReturnCode.OK],
+            check_performance(duration, **thresholds)]
+
+
+rtps_performance_suite_1 = {
+    # RELIABLE, KEEP_ALL: nothing may be lost
+    'Perf_Reliable_1KB_100Hz' : performance_test('-r -k 0', rate=100, payload_size=1024, duration=10,
+            min_throughput=95, max_loss_ratio=0.0, max_latency_p99_us=10000),
+    'Perf_Reliable_1KB_1000Hz' : performance_test('-r -k 0', rate=1000, payload_size=1024, duration=10,
+            min_throughput=950, max_loss_ratio=0.0, max_latency_p99_us=10000),
+    'Perf_Reliable_1KB_10000Hz' : performance_test('-r -k 0', rate=10000, payload_size=1024, duration=10,
+            min_throughput=9500, max_loss_ratio=0.0),
+    # fragmented samples
+    'Perf_Reliable_64KB_100Hz' : performance_test('-r -k 0', rate=100, payload_size=65536, duration=10,
+            min_throughput=95, max_loss_ratio=0.0, max_latency_p99_us=20000),
+    # under a flow controller of 8 MB/s, above the 6.4 MB/s written
+    'Perf_Reliable_64KB_100Hz_FlowLimited' : performance_test('-r -k 0 --flow-rate 8192', rate=100, payload_size=65536, duration=10,
+            min_throughput=95, max_loss_ratio=0.0, max_latency_p99_us=50000),
+
+    # small samples, without and with batching on the writer
+    'Perf_Reliable_64B_10000Hz' : performance_test('-r -k 0', rate=10000, payload_size=64, duration=10,
+            min_throughput=9500, max_loss_ratio=0.0),
+    'Perf_Reliable_64B_10000Hz_Batch' : performance_test('-r -k 0 --batch 100 --batch-flush 1', rate=10000, payload_size=64, duration=10,
+            min_throughput=9500, max_loss_ratio=0.0),
+
+    # BEST_EFFORT: some loss is accepted
+    'Perf_BestEffort_1KB_1000Hz' : performance_test('-b', rate=1000, payload_size=1024, duration=10,
+            min_throughput=900, max_loss_ratio=0.05, max_latency_p99_us=10000),
+    'Perf_BestEffort_1KB_10000Hz' : performance_test('-b', rate=10000, payload_size=1024, duration=10,
+            min_throughput=9000, max_loss_ratio=0.05),
+}